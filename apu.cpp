@@ -0,0 +1,508 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "apu.h"
+#include <algorithm>
+
+namespace ozones {
+
+namespace {
+
+const uint8_t kLengths[32] = {
+    10, 254, 20,  2, 40,  4, 80,  6, 160,  8, 60, 10, 14, 12, 26, 14,
+    12,  16, 24, 18, 48, 20, 96, 22, 192, 24, 72, 26, 16, 28, 32, 30
+};
+
+const uint8_t kDuties[4][8] = {
+    { 0, 1, 0, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 0, 0, 0, 0, 0 },
+    { 0, 1, 1, 1, 1, 0, 0, 0 },
+    { 1, 0, 0, 1, 1, 1, 1, 1 }
+};
+
+const uint8_t kTriangleSequence[32] = {
+    15, 14, 13, 12, 11, 10,  9,  8,  7,  6,  5,  4,  3,  2,  1,  0,
+     0,  1,  2,  3,  4,  5,  6,  7,  8,  9, 10, 11, 12, 13, 14, 15
+};
+
+// NTSC periods in CPU cycles
+const uint16_t kNoisePeriods[16] = {
+    4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
+};
+
+const uint16_t kDmcPeriods[16] = {
+    428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+};
+
+// Cycles between frame counter steps; the first step comes 7457 cycles after a reset
+const int32_t kFirstFrameStep = 7457;
+const int32_t kFrameStepLengths[2][5] = {
+    { 7456, 7458, 7458, 7458, 0 },
+    { 7456, 7458, 7458, 7452, 7458 }
+};
+
+// Linear approximation of the 2A03 mixer, in output sample units per channel step
+const int kPulseWeight = 246;
+const int kTriangleWeight = 279;
+const int kNoiseWeight = 162;
+const int kDmcWeight = 110;
+
+}
+
+Apu::Apu(std::shared_ptr<Ram> cpu_ram, std::shared_ptr<BlipBuffer> blip) : cpu_ram_(cpu_ram), blip_(blip), pulse1_(), pulse2_(), triangle_(), noise_(), dmc_(), frame_counter_mode_(0), frame_step_(0), frame_irq_(false), time_(0), run_time_(0), next_frame_step_(kFirstFrameStep) {
+    pulse1_.ones_complement_negate = true;
+    noise_.shift = 1;
+    noise_.period = kNoisePeriods[0];
+    dmc_.period = kDmcPeriods[0];
+    dmc_.bits_remaining = 8;
+    dmc_.silence = true;
+    ScheduleNextEvent();
+}
+
+uint8_t Apu::ReadByte(size_t addr) {
+    if(addr != 0x4015)
+        return 0;
+    RunUntil(time_);
+    uint8_t status = 0;
+    if(pulse1_.length)
+        status |= 0x01;
+    if(pulse2_.length)
+        status |= 0x02;
+    if(triangle_.length)
+        status |= 0x04;
+    if(noise_.length)
+        status |= 0x08;
+    if(dmc_.bytes_remaining)
+        status |= 0x10;
+    if(frame_irq_)
+        status |= 0x40;
+    if(dmc_.irq)
+        status |= 0x80;
+    frame_irq_ = false;
+    return status;
+}
+
+void Apu::WriteByte(size_t addr, uint8_t value) {
+    RunUntil(time_);
+    Pulse& pulse = addr < 0x4004 ? pulse1_ : pulse2_;
+    switch(addr) {
+    case 0x4000:
+    case 0x4004:
+        pulse.duty = value >> 6;
+        pulse.envelope.loop = value & 0x20;
+        pulse.envelope.constant = value & 0x10;
+        pulse.envelope.period = value & 0x0F;
+        break;
+    case 0x4001:
+    case 0x4005:
+        pulse.sweep_enabled = value & 0x80;
+        pulse.sweep_period = (value >> 4) & 0x07;
+        pulse.sweep_negate = value & 0x08;
+        pulse.sweep_shift = value & 0x07;
+        pulse.sweep_reload = true;
+        break;
+    case 0x4002:
+    case 0x4006:
+        pulse.period = (pulse.period & 0x700) | value;
+        break;
+    case 0x4003:
+    case 0x4007:
+        pulse.period = (pulse.period & 0xFF) | ((value & 0x07) << 8);
+        if(pulse.enabled)
+            pulse.length = kLengths[value >> 3];
+        pulse.sequence = 0;
+        pulse.envelope.start = true;
+        break;
+    case 0x4008:
+        triangle_.control = value & 0x80;
+        triangle_.linear_period = value & 0x7F;
+        break;
+    case 0x400A:
+        triangle_.period = (triangle_.period & 0x700) | value;
+        break;
+    case 0x400B:
+        triangle_.period = (triangle_.period & 0xFF) | ((value & 0x07) << 8);
+        if(triangle_.enabled)
+            triangle_.length = kLengths[value >> 3];
+        triangle_.linear_reload = true;
+        break;
+    case 0x400C:
+        noise_.envelope.loop = value & 0x20;
+        noise_.envelope.constant = value & 0x10;
+        noise_.envelope.period = value & 0x0F;
+        break;
+    case 0x400E:
+        noise_.mode = value & 0x80;
+        noise_.period = kNoisePeriods[value & 0x0F];
+        break;
+    case 0x400F:
+        if(noise_.enabled)
+            noise_.length = kLengths[value >> 3];
+        noise_.envelope.start = true;
+        break;
+    case 0x4010:
+        dmc_.irq_enabled = value & 0x80;
+        if(!dmc_.irq_enabled)
+            dmc_.irq = false;
+        dmc_.loop = value & 0x40;
+        dmc_.period = kDmcPeriods[value & 0x0F];
+        break;
+    case 0x4011:
+        dmc_.output = value & 0x7F;
+        break;
+    case 0x4012:
+        dmc_.sample_address = 0xC000 + value * 64;
+        break;
+    case 0x4013:
+        dmc_.sample_length = value * 16 + 1;
+        break;
+    case 0x4015:
+        pulse1_.enabled = value & 0x01;
+        pulse2_.enabled = value & 0x02;
+        triangle_.enabled = value & 0x04;
+        noise_.enabled = value & 0x08;
+        if(!pulse1_.enabled)
+            pulse1_.length = 0;
+        if(!pulse2_.enabled)
+            pulse2_.length = 0;
+        if(!triangle_.enabled)
+            triangle_.length = 0;
+        if(!noise_.enabled)
+            noise_.length = 0;
+        dmc_.irq = false;
+        if(!(value & 0x10))
+            dmc_.bytes_remaining = 0;
+        else if(!dmc_.bytes_remaining)
+            dmc_.Restart();
+        break;
+    case 0x4017:
+        frame_counter_mode_ = value;
+        if(value & kIrqInhibit)
+            frame_irq_ = false;
+        frame_step_ = 0;
+        next_frame_step_ = time_ + kFirstFrameStep;
+        if(value & kFiveStepMode) {
+            ClockQuarterFrame();
+            ClockHalfFrame();
+        }
+        break;
+    }
+    ScheduleNextEvent();
+}
+
+void Apu::Reset() {
+    WriteByte(0x4015, 0);
+    WriteByte(0x4017, frame_counter_mode_);
+    frame_irq_ = false;
+}
+
+void Apu::EndFrame() {
+    RunUntil(time_);
+    blip_->EndFrame(time_);
+    next_frame_step_ -= time_;
+    run_time_ = 0;
+    time_ = 0;
+    ScheduleNextEvent();
+}
+
+// The channel structs are plain data and copied whole
+void Apu::SaveState(StateWriter& writer) {
+    writer.Write(pulse1_);
+    writer.Write(pulse2_);
+    writer.Write(triangle_);
+    writer.Write(noise_);
+    writer.Write(dmc_);
+    writer.Write(frame_counter_mode_);
+    writer.Write(frame_step_);
+    writer.Write(frame_irq_);
+    writer.Write(time_);
+    writer.Write(run_time_);
+    writer.Write(next_frame_step_);
+    writer.Write(next_event_);
+}
+
+void Apu::LoadState(StateReader& reader) {
+    reader.Read(pulse1_);
+    reader.Read(pulse2_);
+    reader.Read(triangle_);
+    reader.Read(noise_);
+    reader.Read(dmc_);
+    reader.Read(frame_counter_mode_);
+    reader.Read(frame_step_);
+    reader.Read(frame_irq_);
+    reader.Read(time_);
+    reader.Read(run_time_);
+    reader.Read(next_frame_step_);
+    reader.Read(next_event_);
+}
+
+void Apu::RunUntil(int32_t time) {
+    while(true) {
+        int32_t end = std::min(time, next_frame_step_);
+        pulse1_.Run(*blip_, run_time_, end);
+        pulse2_.Run(*blip_, run_time_, end);
+        triangle_.Run(*blip_, run_time_, end);
+        noise_.Run(*blip_, run_time_, end);
+        dmc_.Run(*blip_, *cpu_ram_, run_time_, end);
+        run_time_ = end;
+        if(end < next_frame_step_)
+            break;
+        ClockFrameCounter();
+    }
+    ScheduleNextEvent();
+}
+
+void Apu::ClockFrameCounter() {
+    bool five_step = frame_counter_mode_ & kFiveStepMode;
+    switch(frame_step_) {
+    case 0:
+    case 2:
+        ClockQuarterFrame();
+        break;
+    case 1:
+        ClockQuarterFrame();
+        ClockHalfFrame();
+        break;
+    case 3:
+        if(five_step)
+            break;
+        ClockQuarterFrame();
+        ClockHalfFrame();
+        if(!(frame_counter_mode_ & kIrqInhibit))
+            frame_irq_ = true;
+        break;
+    case 4:
+        ClockQuarterFrame();
+        ClockHalfFrame();
+        break;
+    }
+    next_frame_step_ += kFrameStepLengths[five_step][frame_step_];
+    frame_step_ = (frame_step_ + 1) % (five_step ? 5 : 4);
+}
+
+void Apu::ClockQuarterFrame() {
+    pulse1_.envelope.Clock();
+    pulse2_.envelope.Clock();
+    noise_.envelope.Clock();
+    if(triangle_.linear_reload)
+        triangle_.linear_counter = triangle_.linear_period;
+    else if(triangle_.linear_counter)
+        --triangle_.linear_counter;
+    if(!triangle_.control)
+        triangle_.linear_reload = false;
+}
+
+void Apu::ClockHalfFrame() {
+    if(pulse1_.length && !pulse1_.envelope.loop)
+        --pulse1_.length;
+    if(pulse2_.length && !pulse2_.envelope.loop)
+        --pulse2_.length;
+    if(triangle_.length && !triangle_.control)
+        --triangle_.length;
+    if(noise_.length && !noise_.envelope.loop)
+        --noise_.length;
+    pulse1_.ClockSweep();
+    pulse2_.ClockSweep();
+}
+
+void Apu::ScheduleNextEvent() {
+    next_event_ = next_frame_step_;
+    // A DMC IRQ can only be raised by a sample fetch, which happens at most every 8 output clocks
+    if(dmc_.irq_enabled && !dmc_.loop && dmc_.bytes_remaining)
+        next_event_ = std::min(next_event_, run_time_ + dmc_.delay + 8 * dmc_.period);
+}
+
+void Apu::Envelope::Clock() {
+    if(start) {
+        start = false;
+        decay = 15;
+        divider = period;
+    } else if(divider == 0) {
+        divider = period;
+        if(decay)
+            --decay;
+        else if(loop)
+            decay = 15;
+    } else {
+        --divider;
+    }
+}
+
+uint8_t Apu::Envelope::GetVolume() {
+    return constant ? period : decay;
+}
+
+uint16_t Apu::Pulse::SweepTarget() {
+    int change = period >> sweep_shift;
+    if(sweep_negate)
+        return std::max(0, period - change - (ones_complement_negate ? 1 : 0));
+    return period + change;
+}
+
+bool Apu::Pulse::IsMuted() {
+    return period < 8 || (!sweep_negate && SweepTarget() > 0x7FF);
+}
+
+int Apu::Pulse::GetLevel() {
+    if(!length || IsMuted() || !kDuties[duty][sequence])
+        return 0;
+    return envelope.GetVolume();
+}
+
+void Apu::Pulse::ClockSweep() {
+    if(sweep_divider == 0 && sweep_enabled && sweep_shift && !IsMuted())
+        period = SweepTarget();
+    if(sweep_divider == 0 || sweep_reload) {
+        sweep_divider = sweep_period;
+        sweep_reload = false;
+    } else {
+        --sweep_divider;
+    }
+}
+
+void Apu::Pulse::Run(BlipBuffer& blip, int32_t start, int32_t end) {
+    // Register writes and envelope clocks take effect at the start of the span
+    int new_level = GetLevel();
+    if(new_level != level) {
+        blip.AddDelta(start, (new_level - level) * kPulseWeight);
+        level = new_level;
+    }
+    int32_t timer_period = (period + 1) * 2;
+    int32_t time = start + delay;
+    if(!length || IsMuted()) {
+        // The output can't change, only keep the sequencer phase
+        if(time < end) {
+            int32_t count = (end - time + timer_period - 1) / timer_period;
+            sequence = (sequence + count) & 7;
+            time += count * timer_period;
+        }
+    } else {
+        int volume = envelope.GetVolume();
+        for(; time < end; time += timer_period) {
+            sequence = (sequence + 1) & 7;
+            new_level = kDuties[duty][sequence] ? volume : 0;
+            if(new_level != level) {
+                blip.AddDelta(time, (new_level - level) * kPulseWeight);
+                level = new_level;
+            }
+        }
+    }
+    delay = time - end;
+}
+
+void Apu::Triangle::Run(BlipBuffer& blip, int32_t start, int32_t end) {
+    int32_t timer_period = period + 1;
+    int32_t time = start + delay;
+    // Ultrasonic periods are left silent rather than aliased
+    if(!length || !linear_counter || period < 2) {
+        if(time < end)
+            time += (end - time + timer_period - 1) / timer_period * timer_period;
+    } else {
+        for(; time < end; time += timer_period) {
+            sequence = (sequence + 1) & 31;
+            int new_level = kTriangleSequence[sequence];
+            blip.AddDelta(time, (new_level - level) * kTriangleWeight);
+            level = new_level;
+        }
+    }
+    delay = time - end;
+}
+
+int Apu::Noise::GetLevel() {
+    if(!length || (shift & 1))
+        return 0;
+    return envelope.GetVolume();
+}
+
+void Apu::Noise::Run(BlipBuffer& blip, int32_t start, int32_t end) {
+    int new_level = GetLevel();
+    if(new_level != level) {
+        blip.AddDelta(start, (new_level - level) * kNoiseWeight);
+        level = new_level;
+    }
+    int32_t time = start + delay;
+    int volume = envelope.GetVolume();
+    int tap = mode ? 6 : 1;
+    if(!length || !volume) {
+        // Silent, but the register keeps clocking and its phase is heard once
+        // volume returns. Every cycle is 32767 steps long in mode 0 and 93 or
+        // 31 in mode 1, so only the remainder needs stepping.
+        if(time < end) {
+            int32_t steps = (end - time + period - 1) / period;
+            time += steps * period;
+            for(steps %= mode ? 93 : 32767; steps > 0; --steps) {
+                uint16_t feedback = (shift ^ (shift >> tap)) & 1;
+                shift = (shift >> 1) | (feedback << 14);
+            }
+        }
+    } else {
+        for(; time < end; time += period) {
+            uint16_t feedback = (shift ^ (shift >> tap)) & 1;
+            shift = (shift >> 1) | (feedback << 14);
+            new_level = (shift & 1) ? 0 : volume;
+            if(new_level != level) {
+                blip.AddDelta(time, (new_level - level) * kNoiseWeight);
+                level = new_level;
+            }
+        }
+    }
+    delay = time - end;
+}
+
+void Apu::Dmc::Restart() {
+    address = sample_address;
+    bytes_remaining = sample_length;
+}
+
+void Apu::Dmc::Run(BlipBuffer& blip, Ram& cpu_ram, int32_t start, int32_t end) {
+    if(output != level) {
+        blip.AddDelta(start, (output - level) * kDmcWeight);
+        level = output;
+    }
+    int32_t time = start + delay;
+    if(silence && !buffer_full && !bytes_remaining) {
+        // Idle: only the bit counter moves
+        if(time < end) {
+            int32_t count = (end - time + period - 1) / period;
+            bits_remaining = 8 - (8 - bits_remaining + count) % 8;
+            time += count * period;
+        }
+    }
+    for(; time < end; time += period) {
+        if(!silence) {
+            if(shift & 1) {
+                if(output <= 125)
+                    output += 2;
+            } else if(output >= 2) {
+                output -= 2;
+            }
+            shift >>= 1;
+        }
+        if(--bits_remaining == 0) {
+            bits_remaining = 8;
+            silence = !buffer_full;
+            if(buffer_full) {
+                shift = buffer;
+                buffer_full = false;
+            }
+        }
+        if(!buffer_full && bytes_remaining) {
+            buffer = cpu_ram.ReadByte(address);
+            buffer_full = true;
+            address = address == 0xFFFF ? 0x8000 : address + 1;
+            if(--bytes_remaining == 0) {
+                if(loop)
+                    Restart();
+                else if(irq_enabled)
+                    irq = true;
+            }
+        }
+        if(output != level) {
+            blip.AddDelta(time, (output - level) * kDmcWeight);
+            level = output;
+        }
+    }
+    delay = time - end;
+}
+
+}
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include "blip_buffer.h"
+#include "ram.h"
+#include "state.h"
+
+namespace ozones {
+
+// 2A03 sound channels and frame counter. Channels are stepped lazily, only
+// on register access, frame counter events and at the end of a frame, and
+// emit band-limited deltas into a BlipBuffer only when their level changes.
+class Apu : public Mappable {
+public:
+    static constexpr double kCpuClockRate = 1789773.0;
+    Apu(std::shared_ptr<Ram> cpu_ram, std::shared_ptr<BlipBuffer> blip);
+    uint8_t ReadByte(size_t addr) override;
+    void WriteByte(size_t addr, uint8_t value) override;
+    void Tick(int cycles) {
+        time_ += cycles;
+        if(time_ >= next_event_)
+            RunUntil(time_);
+    }
+    bool IsIrqPending() {
+        return frame_irq_ || dmc_.irq;
+    }
+    // Flushes the frame's audio into the blip buffer
+    void EndFrame();
+    // The reset line silences every channel and restarts the frame counter in its current mode
+    void Reset();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+private:
+    enum FrameCounterFlags {
+        kIrqInhibit     = 0x40,
+        kFiveStepMode   = 0x80
+    };
+    struct Envelope {
+        bool start, loop, constant;
+        uint8_t period, divider, decay;
+        void Clock();
+        uint8_t GetVolume();
+    };
+    struct Pulse {
+        bool ones_complement_negate;
+        bool enabled;
+        uint8_t duty, sequence, length;
+        uint16_t period;
+        Envelope envelope;
+        bool sweep_enabled, sweep_negate, sweep_reload;
+        uint8_t sweep_period, sweep_shift, sweep_divider;
+        int32_t delay;
+        int level;
+        uint16_t SweepTarget();
+        bool IsMuted();
+        int GetLevel();
+        void ClockSweep();
+        void Run(BlipBuffer& blip, int32_t start, int32_t end);
+    };
+    struct Triangle {
+        bool enabled, control, linear_reload;
+        uint8_t sequence, length, linear_counter, linear_period;
+        uint16_t period;
+        int32_t delay;
+        int level;
+        void Run(BlipBuffer& blip, int32_t start, int32_t end);
+    };
+    struct Noise {
+        bool enabled, mode;
+        uint8_t length;
+        uint16_t period, shift;
+        Envelope envelope;
+        int32_t delay;
+        int level;
+        int GetLevel();
+        void Run(BlipBuffer& blip, int32_t start, int32_t end);
+    };
+    struct Dmc {
+        bool irq_enabled, loop, irq, silence, buffer_full;
+        uint8_t output, shift, bits_remaining, buffer;
+        uint16_t period, sample_address, sample_length, address, bytes_remaining;
+        int32_t delay;
+        int level;
+        void Restart();
+        void Run(BlipBuffer& blip, Ram& cpu_ram, int32_t start, int32_t end);
+    };
+    void RunUntil(int32_t time);
+    void ClockFrameCounter();
+    void ClockQuarterFrame();
+    void ClockHalfFrame();
+    void ScheduleNextEvent();
+    std::shared_ptr<Ram> cpu_ram_;
+    std::shared_ptr<BlipBuffer> blip_;
+    Pulse pulse1_, pulse2_;
+    Triangle triangle_;
+    Noise noise_;
+    Dmc dmc_;
+    uint8_t frame_counter_mode_;
+    int frame_step_;
+    bool frame_irq_;
+    // CPU cycles since the start of the audio frame
+    int32_t time_;
+    // Channels have been run up to this time
+    int32_t run_time_;
+    int32_t next_frame_step_;
+    int32_t next_event_;
+};
+
+}
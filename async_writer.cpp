@@ -0,0 +1,126 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "async_writer.h"
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+namespace ozones {
+
+AsyncWriter::AsyncWriter(const std::string& path, size_t max_queued_chunks) : path_(path),
+        max_queued_(std::max(max_queued_chunks, (size_t) 1)), finishing_(false), failed_(false),
+        finished_(false), size_(0), stall_seconds_(0.0) {
+    file_ = path == "-" ? stdout : std::fopen(path.c_str(), "wb");
+    if(!file_)
+        throw std::runtime_error("Cannot open " + path);
+    // Chunks are already as large as any stdio buffer would be
+    std::setvbuf(file_, nullptr, _IONBF, 0);
+    chunk_.reserve(kChunkSize);
+    writer_ = std::thread(&AsyncWriter::WriterLoop, this);
+}
+
+AsyncWriter::~AsyncWriter() {
+    try {
+        Finish();
+    } catch(std::runtime_error&) {
+    }
+    if(file_ != stdout)
+        std::fclose(file_);
+}
+
+void AsyncWriter::Write(const void* data, size_t size) {
+    const uint8_t* bytes = (const uint8_t*) data;
+    size_ += size;
+    while(size != 0) {
+        size_t count = std::min(size, kChunkSize - chunk_.size());
+        chunk_.insert(chunk_.end(), bytes, bytes + count);
+        bytes += count;
+        size -= count;
+        if(chunk_.size() == kChunkSize)
+            QueueChunk();
+    }
+}
+
+void AsyncWriter::QueueChunk() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if(queue_.size() >= max_queued_ && !failed_) {
+        auto start = std::chrono::steady_clock::now();
+        written_cv_.wait(lock, [this]() { return queue_.size() < max_queued_ || failed_; });
+        stall_seconds_ += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    if(failed_)
+        throw std::runtime_error("Cannot write " + path_);
+    queue_.push_back(std::move(chunk_));
+    if(spare_.empty()) {
+        chunk_ = std::vector<uint8_t>();
+        chunk_.reserve(kChunkSize);
+    } else {
+        chunk_ = std::move(spare_.back());
+        spare_.pop_back();
+    }
+    lock.unlock();
+    queued_cv_.notify_one();
+}
+
+void AsyncWriter::Finish() {
+    if(finished_)
+        return;
+    finished_ = true;
+    {
+        // The last, partial chunk may go one over the bound
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!chunk_.empty() && !failed_)
+            queue_.push_back(std::move(chunk_));
+        finishing_ = true;
+    }
+    queued_cv_.notify_one();
+    writer_.join();
+    if(failed_ || std::fflush(file_) != 0)
+        throw std::runtime_error("Cannot write " + path_);
+}
+
+bool AsyncWriter::Rewrite(size_t offset, const void* data, size_t size) {
+    if(!finished_)
+        throw std::runtime_error("Rewrite before Finish");
+    if(std::fseek(file_, (long) offset, SEEK_SET) != 0)
+        return false;
+    if(std::fwrite(data, 1, size, file_) != size || std::fseek(file_, 0, SEEK_END) != 0)
+        throw std::runtime_error("Cannot write " + path_);
+    return true;
+}
+
+uint64_t AsyncWriter::GetSize() {
+    return size_;
+}
+
+double AsyncWriter::GetStallSeconds() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stall_seconds_;
+}
+
+void AsyncWriter::WriterLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;) {
+        queued_cv_.wait(lock, [this]() { return !queue_.empty() || finishing_; });
+        if(queue_.empty())
+            return;
+        std::vector<uint8_t> chunk = std::move(queue_.front());
+        queue_.pop_front();
+        lock.unlock();
+        bool written = std::fwrite(chunk.data(), 1, chunk.size(), file_) == chunk.size();
+        chunk.clear();
+        lock.lock();
+        spare_.push_back(std::move(chunk));
+        if(!written) {
+            // Nothing more can be written; queued data is dropped and Write reports the error
+            failed_ = true;
+            queue_.clear();
+            written_cv_.notify_one();
+            return;
+        }
+        written_cv_.notify_one();
+    }
+}
+
+}
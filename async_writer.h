@@ -0,0 +1,55 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace ozones {
+
+// Streams bytes to a file or pipe from a background thread. Writes are
+// gathered into large chunks and queued; the caller only waits when the
+// bounded queue is full, i.e. when the output can't keep up at all.
+class AsyncWriter {
+public:
+    static const size_t kChunkSize = 1 << 20;
+    // "-" is standard output
+    AsyncWriter(const std::string& path, size_t max_queued_chunks = 32);
+    ~AsyncWriter();
+    AsyncWriter(const AsyncWriter&) = delete;
+    AsyncWriter& operator=(const AsyncWriter&) = delete;
+    void Write(const void* data, size_t size);
+    // Writes out everything queued and stops the thread; the destructor finishes an unfinished writer
+    void Finish();
+    // After Finish, overwrites bytes already written, e.g. a header with sizes
+    // only known at the end. Returns false if the output is a pipe.
+    bool Rewrite(size_t offset, const void* data, size_t size);
+    // Bytes passed to Write so far
+    uint64_t GetSize();
+    // Time Write spent waiting for room in the queue
+    double GetStallSeconds();
+private:
+    void QueueChunk();
+    void WriterLoop();
+    std::string path_;
+    FILE* file_;
+    size_t max_queued_;
+    std::vector<uint8_t> chunk_;
+    std::mutex mutex_;
+    std::condition_variable queued_cv_;
+    std::condition_variable written_cv_;
+    std::deque<std::vector<uint8_t>> queue_;
+    // Written chunks handed back so steady streaming doesn't allocate
+    std::vector<std::vector<uint8_t>> spare_;
+    bool finishing_, failed_, finished_;
+    uint64_t size_;
+    double stall_seconds_;
+    std::thread writer_;
+};
+
+}
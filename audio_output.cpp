@@ -0,0 +1,56 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "audio_output.h"
+#include <algorithm>
+
+namespace ozones {
+
+namespace {
+
+size_t LatencySamples(unsigned sample_rate, int latency_ms) {
+    return std::max<size_t>((size_t) sample_rate * std::max(latency_ms, 1) / 1000, 512);
+}
+
+}
+
+// SFML keeps three chunks queued, so an eighth of the latency per chunk leaves
+// about half of it for the ring. The ring's fill is sampled just before each
+// push, when it is at its lowest.
+AudioOutput::AudioOutput(unsigned sample_rate, int latency_ms) : ring_(LatencySamples(sample_rate, latency_ms) * 4), chunk_(LatencySamples(sample_rate, latency_ms) / 8), target_fill_(LatencySamples(sample_rate, latency_ms) / 2), adjustment_(1.0), last_sample_(0), underruns_(0) {
+    initialize(1, sample_rate);
+}
+
+void AudioOutput::Push(const int16_t* samples, size_t count) {
+    // Below the target fill the producer runs slightly fast, above it slightly slow
+    double error = ((double) target_fill_ - (double) ring_.GetSize()) / target_fill_;
+    adjustment_ = 1.0 + kMaxRateDeviation * std::max(-1.0, std::min(1.0, error));
+    ring_.Write(samples, count);
+}
+
+double AudioOutput::GetRateAdjustment() {
+    return adjustment_;
+}
+
+unsigned AudioOutput::GetUnderruns() {
+    return underruns_.load(std::memory_order_relaxed);
+}
+
+bool AudioOutput::onGetData(Chunk& data) {
+    size_t count = ring_.Read(chunk_.data(), chunk_.size());
+    if(count)
+        last_sample_ = chunk_[count - 1];
+    if(count < chunk_.size()) {
+        // Hold the last level instead of dropping to zero, which would click
+        std::fill(chunk_.begin() + count, chunk_.end(), last_sample_);
+        underruns_.fetch_add(1, std::memory_order_relaxed);
+    }
+    data.samples = chunk_.data();
+    data.sampleCount = chunk_.size();
+    return true;
+}
+
+void AudioOutput::onSeek(sf::Time) {
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <SFML/Audio.hpp>
+#include "spsc_ring.h"
+
+namespace ozones {
+
+// Plays mono samples pushed by the emulation thread. Samples pass through a
+// lock-free ring, and the producer is told how far to nudge its sample rate
+// to hold the ring at its target fill despite clock drift between the two.
+class AudioOutput : public sf::SoundStream {
+public:
+    // latency_ms is the approximate total of the ring target and SFML's queued chunks
+    AudioOutput(unsigned sample_rate, int latency_ms);
+    // Emulation thread: queues samples, dropping whatever doesn't fit
+    void Push(const int16_t* samples, size_t count);
+    // Factor to scale the producer's sample rate by, within kMaxRateDeviation of 1
+    double GetRateAdjustment();
+    unsigned GetUnderruns();
+protected:
+    bool onGetData(Chunk& data) override;
+    void onSeek(sf::Time time_offset) override;
+private:
+    static constexpr double kMaxRateDeviation = 0.005;
+    SpscRing<int16_t> ring_;
+    std::vector<int16_t> chunk_;
+    size_t target_fill_;
+    double adjustment_;
+    int16_t last_sample_;
+    std::atomic<unsigned> underruns_;
+};
+
+}
@@ -0,0 +1,239 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "cartridge.h"
+#include "machine.h"
+#include "movie.h"
+#include "work_stealing_pool.h"
+
+using namespace ozones;
+
+namespace {
+
+// A ROM run for a number of frames with no input, or through a movie's inputs
+struct Job {
+    std::string rom;
+    std::string movie;
+    uint64_t frames;
+};
+
+struct Result {
+    uint64_t frames;
+    uint64_t state_hash;
+    std::vector<uint64_t> frame_hashes;
+    int64_t diverged_at;
+    size_t instance_bytes;
+    double seconds;
+    std::string error;
+};
+
+// One job per line: "rom frames" or "rom movie"; blank lines and lines starting with # are skipped
+std::vector<Job> ReadJobs(const std::string& path) {
+    std::ifstream file(path);
+    if(!file)
+        throw std::runtime_error("Cannot open " + path);
+    std::vector<Job> jobs;
+    std::string line;
+    while(std::getline(file, line)) {
+        if(line.empty() || line[0] == '#')
+            continue;
+        std::istringstream fields(line);
+        Job job;
+        std::string length;
+        if(!(fields >> job.rom >> length))
+            throw std::runtime_error("Malformed job: " + line);
+        char* end;
+        job.frames = std::strtoull(length.c_str(), &end, 10);
+        if(*end != '\0') {
+            job.movie = length;
+            job.frames = 0;
+        }
+        jobs.push_back(job);
+    }
+    return jobs;
+}
+
+// Cartridges by ROM path, so jobs on the same ROM share its data and decode table
+class CartridgeCache {
+public:
+    std::shared_ptr<Cartridge> Get(const std::string& path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::shared_ptr<Cartridge>& cartridge = cartridges_[path];
+        if(!cartridge) {
+            std::ifstream rom(path, std::ios::in | std::ios::binary);
+            if(!rom) {
+                cartridges_.erase(path);
+                throw std::runtime_error("Cannot open " + path);
+            }
+            try {
+                cartridge = std::make_shared<Cartridge>(rom);
+            } catch(std::runtime_error&) {
+                cartridges_.erase(path);
+                throw;
+            }
+        }
+        return cartridge;
+    }
+private:
+    std::mutex mutex_;
+    std::map<std::string, std::shared_ptr<Cartridge>> cartridges_;
+};
+
+Result RunJob(const Job& job, uint32_t hash_interval, CartridgeCache& cartridges) {
+    Result result = {};
+    result.diverged_at = -1;
+    auto start = std::chrono::steady_clock::now();
+    Machine machine(cartridges.Get(job.rom));
+    machine.SetAudioEnabled(false);
+    std::unique_ptr<MovieReader> movie;
+    result.frames = job.frames;
+    if(!job.movie.empty()) {
+        movie = std::make_unique<MovieReader>(job.movie);
+        if(movie->GetRomHash() != machine.GetRomHash())
+            throw std::runtime_error("Movie was recorded with another ROM");
+        result.frames = movie->GetFrameCount();
+    }
+    for(uint64_t frame = 0; frame < result.frames; ++frame) {
+        if(movie) {
+            uint16_t input = movie->GetInput(frame);
+            machine.SetButtons(0, input & 0xFF);
+            machine.SetButtons(1, input >> 8);
+        }
+        machine.RunFrame(Ppu::kRenderTimingOnly);
+        bool sample = hash_interval != 0 && (frame + 1) % hash_interval == 0;
+        bool check = movie && result.diverged_at < 0 && movie->HasHash(frame);
+        if(!sample && !check)
+            continue;
+        uint64_t hash = machine.GetStateHash();
+        if(sample)
+            result.frame_hashes.push_back(hash);
+        if(check && !movie->MatchesHash(frame, hash))
+            result.diverged_at = (int64_t) frame;
+    }
+    result.state_hash = machine.GetStateHash();
+    result.instance_bytes = machine.GetFootprint().instance;
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return result;
+}
+
+std::string EscapeJson(const std::string& text) {
+    std::string escaped;
+    for(char c : text) {
+        if(c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if((unsigned char) c < 0x20) {
+            char code[7];
+            std::snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+// Hashes are written as hex strings, since JSON numbers can't hold all 64 bits
+std::string FormatHash(uint64_t hash) {
+    char text[19];
+    std::snprintf(text, sizeof(text), "\"%016llx\"", (unsigned long long) hash);
+    return text;
+}
+
+std::string FormatResult(size_t index, const Job& job, const Result& result) {
+    std::ostringstream line;
+    line << "{\"job\":" << index << ",\"rom\":\"" << EscapeJson(job.rom) << "\"";
+    if(!job.movie.empty())
+        line << ",\"movie\":\"" << EscapeJson(job.movie) << "\"";
+    if(!result.error.empty()) {
+        line << ",\"error\":\"" << EscapeJson(result.error) << "\"}";
+        return line.str();
+    }
+    line << ",\"frames\":" << result.frames << ",\"state_hash\":" << FormatHash(result.state_hash);
+    line << ",\"frame_hashes\":[";
+    for(size_t i = 0; i < result.frame_hashes.size(); ++i)
+        line << (i ? "," : "") << FormatHash(result.frame_hashes[i]);
+    line << "]";
+    if(!job.movie.empty())
+        line << ",\"diverged_at\":" << result.diverged_at;
+    line << ",\"instance_bytes\":" << result.instance_bytes;
+    line << ",\"seconds\":" << result.seconds << ",\"fps\":" << (result.seconds > 0 ? result.frames / result.seconds : 0) << "}";
+    return line.str();
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    // ozones-batch [--threads N] [--pin] [--hash-interval N] [--output file] jobs
+    unsigned threads = std::thread::hardware_concurrency();
+    bool pin = false;
+    uint32_t hash_interval = 60;
+    std::string output_path, jobs_path;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--threads" && i + 1 < argc)
+            threads = (unsigned) std::atoi(argv[++i]);
+        else if(arg == "--pin")
+            pin = true;
+        else if(arg == "--hash-interval" && i + 1 < argc)
+            hash_interval = (uint32_t) std::atoi(argv[++i]);
+        else if(arg == "--output" && i + 1 < argc)
+            output_path = argv[++i];
+        else
+            jobs_path = arg;
+    }
+    if(jobs_path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--threads N] [--pin] [--hash-interval N] [--output file] jobs" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::vector<Job> jobs;
+    try {
+        jobs = ReadJobs(jobs_path);
+    } catch(std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ofstream output_file;
+    if(!output_path.empty()) {
+        output_file.open(output_path);
+        if(!output_file) {
+            std::cerr << "Cannot open " << output_path << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::ostream& output = output_path.empty() ? std::cout : output_file;
+    // Results are written as soon as each job finishes, one JSON object per line
+    std::mutex output_mutex;
+    bool failed = false;
+    CartridgeCache cartridges;
+    WorkStealingPool pool(threads, pin);
+    pool.Run(jobs.size(), [&](size_t index, unsigned) {
+        Result result;
+        try {
+            result = RunJob(jobs[index], hash_interval, cartridges);
+        } catch(std::runtime_error& e) {
+            result = {};
+            result.error = e.what();
+        }
+        std::string line = FormatResult(index, jobs[index], result);
+        std::lock_guard<std::mutex> lock(output_mutex);
+        output << line << std::endl;
+        failed |= !result.error.empty() || result.diverged_at >= 0;
+    });
+    return failed ? EXIT_FAILURE : EXIT_SUCCESS;
+}
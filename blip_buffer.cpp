@@ -0,0 +1,128 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "blip_buffer.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace ozones {
+
+const BlipBuffer::Kernel BlipBuffer::kKernel = BlipBuffer::BuildKernel();
+
+BlipBuffer::BlipBuffer(double clock_rate, double sample_rate, size_t max_samples, bool muted) : offset_(0), available_(0), integrator_(0), max_samples_(max_samples), muted_(true) {
+    SetRates(clock_rate, sample_rate);
+    SetMuted(muted);
+}
+
+void BlipBuffer::SetRates(double clock_rate, double sample_rate) {
+    if(sample_rate >= clock_rate)
+        throw std::runtime_error("Blip buffer sample rate must be below its clock rate");
+    clock_rate_ = clock_rate;
+    sample_rate_ = sample_rate;
+    factor_ = (uint64_t) std::ceil(sample_rate / clock_rate * (double) (1ULL << kTimeBits));
+}
+
+double BlipBuffer::GetSampleRate() {
+    return sample_rate_;
+}
+
+void BlipBuffer::AddDelta(uint32_t time, int delta) {
+    if(muted_)
+        return;
+    uint64_t position = offset_ + time * factor_;
+    size_t index = available_ + (position >> kTimeBits);
+    if(index + kWidth > buffer_.size())
+        return;
+    const std::array<int16_t, kWidth>& kernel = kKernel[(position >> (kTimeBits - kPhaseBits)) & (kPhases - 1)];
+    int32_t* out = &buffer_[index];
+    for(int i = 0; i < kWidth; ++i)
+        out[i] += kernel[i] * delta;
+}
+
+void BlipBuffer::EndFrame(uint32_t time) {
+    if(muted_)
+        return;
+    uint64_t position = offset_ + time * factor_;
+    available_ = std::min(available_ + (size_t) (position >> kTimeBits), buffer_.size() - kWidth - 1);
+    offset_ = position & ((1ULL << kTimeBits) - 1);
+}
+
+size_t BlipBuffer::SamplesAvailable() {
+    return available_;
+}
+
+size_t BlipBuffer::ReadSamples(int16_t* out, size_t count) {
+    count = std::min(count, available_);
+    int32_t sum = integrator_;
+    for(size_t i = 0; i < count; ++i) {
+        int32_t sample = sum >> kDeltaBits;
+        sum += buffer_[i];
+        out[i] = (int16_t) std::max(-32768, std::min(32767, sample));
+        sum -= sample << (kDeltaBits - kBassShift);
+    }
+    integrator_ = sum;
+    RemoveSamples(count);
+    return count;
+}
+
+void BlipBuffer::RemoveSamples(size_t count) {
+    if(buffer_.empty())
+        return;
+    count = std::min(count, available_);
+    size_t remaining = available_ + kWidth - count;
+    std::move(buffer_.begin() + count, buffer_.begin() + count + remaining, buffer_.begin());
+    std::fill(buffer_.begin() + remaining, buffer_.begin() + remaining + count, 0);
+    available_ -= count;
+}
+
+void BlipBuffer::Clear() {
+    std::fill(buffer_.begin(), buffer_.end(), 0);
+    offset_ = 0;
+    available_ = 0;
+    integrator_ = 0;
+}
+
+void BlipBuffer::SetMuted(bool muted) {
+    muted_ = muted;
+    if(!muted_ && buffer_.empty())
+        buffer_.resize(max_samples_ + kWidth + 1);
+}
+
+bool BlipBuffer::IsMuted() {
+    return muted_;
+}
+
+size_t BlipBuffer::GetMemoryUsage() {
+    return sizeof(*this) + buffer_.capacity() * sizeof(int32_t);
+}
+
+// Band-limited step derivative: a Blackman-windowed sinc per sub-sample phase,
+// each normalised to sum to exactly 1 << kDeltaBits so steps integrate cleanly
+BlipBuffer::Kernel BlipBuffer::BuildKernel() {
+    const double kPi = 3.14159265358979323846;
+    // Slightly below Nyquist of the output rate
+    const double kCutoff = 0.9;
+    Kernel kernel;
+    for(int phase = 0; phase < kPhases; ++phase) {
+        double taps[kWidth];
+        double total = 0;
+        for(int i = 0; i < kWidth; ++i) {
+            double x = i - (kWidth / 2 - 1) - (double) phase / kPhases;
+            double sinc = x == 0 ? 1.0 : std::sin(kPi * kCutoff * x) / (kPi * kCutoff * x);
+            double n = (x + kWidth / 2) / kWidth;
+            double window = 0.42 - 0.5 * std::cos(2 * kPi * n) + 0.08 * std::cos(4 * kPi * n);
+            taps[i] = sinc * window;
+            total += taps[i];
+        }
+        int sum = 0;
+        for(int i = 0; i < kWidth; ++i) {
+            kernel[phase][i] = (int16_t) std::lround(taps[i] / total * (1 << kDeltaBits));
+            sum += kernel[phase][i];
+        }
+        kernel[phase][kWidth / 2 - 1] += (1 << kDeltaBits) - sum;
+    }
+    return kernel;
+}
+
+}
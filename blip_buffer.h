@@ -0,0 +1,57 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ozones {
+
+// Band-limited synthesis buffer: sources add amplitude deltas at clock times,
+// each delta is spread as a windowed-sinc step onto the output sample grid,
+// and reading integrates the deltas into samples.
+class BlipBuffer {
+public:
+    // The buffer isn't allocated until the first time it is unmuted
+    BlipBuffer(double clock_rate, double sample_rate, size_t max_samples, bool muted = false);
+    // May be nudged between frames, e.g. for dynamic rate control
+    void SetRates(double clock_rate, double sample_rate);
+    double GetSampleRate();
+    // time is in clocks since the last EndFrame
+    void AddDelta(uint32_t time, int delta);
+    // Makes the samples before time available and starts a new frame there
+    void EndFrame(uint32_t time);
+    size_t SamplesAvailable();
+    size_t ReadSamples(int16_t* out, size_t count);
+    void RemoveSamples(size_t count);
+    void Clear();
+    // While muted deltas and frames are discarded, e.g. for frames emulated ahead and rolled back
+    void SetMuted(bool muted);
+    bool IsMuted();
+    // Object and heap bytes
+    size_t GetMemoryUsage();
+private:
+    static const int kPhaseBits = 5;
+    static const int kPhases = 1 << kPhaseBits;
+    static const int kWidth = 16;
+    static const int kDeltaBits = 15;
+    // Cutoff of the DC-removing high-pass filter
+    static const int kBassShift = 9;
+    static const int kTimeBits = 32;
+    typedef std::array<std::array<int16_t, kWidth>, kPhases> Kernel;
+    static Kernel BuildKernel();
+    static const Kernel kKernel;
+    double clock_rate_;
+    double sample_rate_;
+    // Output samples per clock in 32.32 fixed point
+    uint64_t factor_;
+    // Fractional output position of the current frame's time 0
+    uint64_t offset_;
+    size_t available_;
+    int32_t integrator_;
+    size_t max_samples_;
+    bool muted_;
+    std::vector<int32_t> buffer_;
+};
+
+}
@@ -0,0 +1,39 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "branch_search.h"
+#include <memory>
+
+namespace ozones {
+
+BranchSearch::BranchSearch(unsigned threads, bool pin_threads) : pool_(threads, pin_threads) { }
+
+std::vector<double> BranchSearch::Evaluate(Machine& root, const std::vector<uint16_t>& inputs, int frames, const Score& score) {
+    struct Worker {
+        std::unique_ptr<Machine> fork;
+        std::vector<uint8_t> root_state;
+        uint32_t epoch;
+    };
+    std::vector<Worker> workers(pool_.GetThreadCount());
+    std::vector<double> scores(inputs.size());
+    pool_.Run(inputs.size(), [&](size_t branch, unsigned index) {
+        Worker& worker = workers[index];
+        if(!worker.fork) {
+            // Forking only reads the root, so workers can do it concurrently
+            worker.fork = root.Fork();
+            worker.fork->SetAudioEnabled(false);
+            worker.epoch = worker.fork->SaveState(worker.root_state);
+        } else {
+            worker.epoch = worker.fork->RestoreState(worker.root_state, worker.epoch);
+        }
+        Machine& machine = *worker.fork;
+        machine.SetButtons(0, inputs[branch] & 0xFF);
+        machine.SetButtons(1, inputs[branch] >> 8);
+        for(int frame = 0; frame < frames; ++frame)
+            machine.RunFrame(Ppu::kRenderTimingOnly);
+        scores[branch] = score(machine);
+    });
+    return scores;
+}
+
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+#include "machine.h"
+#include "work_stealing_pool.h"
+
+namespace ozones {
+
+// TAS-style search: from a root machine, holds each candidate input for a
+// number of frames and scores the state every branch ends up in. Each worker
+// forks the root once and rolls its fork back between branches, copying only
+// the memory pages the last branch wrote.
+class BranchSearch {
+public:
+    // Called on the worker's fork after a branch; may read e.g. GetRam()
+    typedef std::function<double(Machine&)> Score;
+    BranchSearch(unsigned threads, bool pin_threads = false);
+    // Inputs hold both controllers, port 1 in the low byte, as in movies.
+    // Returns the score of each input in order; root is left untouched.
+    std::vector<double> Evaluate(Machine& root, const std::vector<uint16_t>& inputs, int frames, const Score& score);
+private:
+    WorkStealingPool pool_;
+};
+
+}
@@ -0,0 +1,123 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "capture.h"
+#include <cstring>
+#include "ppu.h"
+
+namespace ozones {
+
+namespace {
+
+const int kPixels = Ppu::kScreenWidth * Ppu::kScreenHeight;
+
+// The NTSC frame rate, 39375000/655171 exactly, and the 8:7 pixel aspect ratio
+const char kY4mHeader[] = "YUV4MPEG2 W256 H240 F39375000:655171 Ip A8:7 C444\n";
+const char kY4mFrameHeader[] = "FRAME\n";
+
+struct WavHeader {
+    char riff[4];
+    uint32_t riff_size;
+    char wave[4];
+    char fmt[4];
+    uint32_t fmt_size;
+    uint16_t format;
+    uint16_t channels;
+    uint32_t sample_rate;
+    uint32_t byte_rate;
+    uint16_t block_align;
+    uint16_t bits_per_sample;
+    char data[4];
+    uint32_t data_size;
+};
+
+static_assert(sizeof(WavHeader) == 44, "WAV header is packed");
+
+WavHeader MakeWavHeader(uint32_t sample_rate, uint32_t data_size) {
+    WavHeader header;
+    std::memcpy(header.riff, "RIFF", 4);
+    header.riff_size = data_size == UINT32_MAX ? UINT32_MAX : data_size + sizeof(WavHeader) - 8;
+    std::memcpy(header.wave, "WAVE", 4);
+    std::memcpy(header.fmt, "fmt ", 4);
+    header.fmt_size = 16;
+    header.format = 1;
+    header.channels = 1;
+    header.sample_rate = sample_rate;
+    header.byte_rate = sample_rate * 2;
+    header.block_align = 2;
+    header.bits_per_sample = 16;
+    std::memcpy(header.data, "data", 4);
+    header.data_size = data_size;
+    return header;
+}
+
+}
+
+VideoCapture::VideoCapture(const std::string& path, Format format) : writer_(path), format_(format),
+                                                                     frame_(kPixels * 3), frame_count_(0) {
+    if(format_ == kY4m)
+        writer_.Write(kY4mHeader, sizeof(kY4mHeader) - 1);
+}
+
+VideoCapture::Format VideoCapture::GetFormatForPath(const std::string& path) {
+    size_t dot = path.rfind('.');
+    return dot != std::string::npos && path.substr(dot) == ".rgb" ? kRgb : kY4m;
+}
+
+void VideoCapture::AddFrame(const uint32_t* rgba) {
+    uint8_t* out = frame_.data();
+    if(format_ == kRgb) {
+        for(int i = 0; i < kPixels; ++i) {
+            out[i * 3] = rgba[i] & 0xFF;
+            out[i * 3 + 1] = (rgba[i] >> 8) & 0xFF;
+            out[i * 3 + 2] = (rgba[i] >> 16) & 0xFF;
+        }
+    } else {
+        // Y, U and V planes
+        for(int i = 0; i < kPixels; ++i) {
+            int r = rgba[i] & 0xFF, g = (rgba[i] >> 8) & 0xFF, b = (rgba[i] >> 16) & 0xFF;
+            out[i] = (uint8_t) (((66 * r + 129 * g + 25 * b + 128) >> 8) + 16);
+            out[kPixels + i] = (uint8_t) (((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128);
+            out[kPixels * 2 + i] = (uint8_t) (((112 * r - 94 * g - 18 * b + 128) >> 8) + 128);
+        }
+        writer_.Write(kY4mFrameHeader, sizeof(kY4mFrameHeader) - 1);
+    }
+    writer_.Write(frame_.data(), frame_.size());
+    ++frame_count_;
+}
+
+void VideoCapture::Finish() {
+    writer_.Finish();
+}
+
+uint64_t VideoCapture::GetFrameCount() {
+    return frame_count_;
+}
+
+double VideoCapture::GetStallSeconds() {
+    return writer_.GetStallSeconds();
+}
+
+AudioCapture::AudioCapture(const std::string& path, uint32_t sample_rate) : writer_(path), sample_rate_(sample_rate) {
+    WavHeader header = MakeWavHeader(sample_rate, UINT32_MAX);
+    writer_.Write(&header, sizeof(header));
+}
+
+void AudioCapture::AddSamples(const int16_t* samples, size_t count) {
+    writer_.Write(samples, count * sizeof(int16_t));
+}
+
+void AudioCapture::Finish() {
+    writer_.Finish();
+    uint64_t data_size = writer_.GetSize() - sizeof(WavHeader);
+    if(data_size > UINT32_MAX - sizeof(WavHeader))
+        return;
+    WavHeader header = MakeWavHeader(sample_rate_, (uint32_t) data_size);
+    writer_.Rewrite(0, &header, sizeof(header));
+}
+
+double AudioCapture::GetStallSeconds() {
+    return writer_.GetStallSeconds();
+}
+
+}
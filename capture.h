@@ -0,0 +1,50 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "async_writer.h"
+
+namespace ozones {
+
+// Headless recording of the picture for offline encoding, e.g.
+// ffmpeg -i video.y4m -i audio.wav out.mkv. Conversion runs on the caller;
+// the bytes go out through an AsyncWriter.
+class VideoCapture {
+public:
+    enum Format {
+        // YUV4MPEG2 4:4:4, BT.601 limited range, so the pixel art isn't chroma subsampled
+        kY4m,
+        // Headerless RGB24, for ffmpeg -f rawvideo -pix_fmt rgb24 -s 256x240
+        kRgb
+    };
+    VideoCapture(const std::string& path, Format format);
+    // .rgb files are kRgb, anything else, pipes included, is kY4m
+    static Format GetFormatForPath(const std::string& path);
+    // A frame from Machine::GetRgbaFramebuffer
+    void AddFrame(const uint32_t* rgba);
+    void Finish();
+    uint64_t GetFrameCount();
+    double GetStallSeconds();
+private:
+    AsyncWriter writer_;
+    Format format_;
+    std::vector<uint8_t> frame_;
+    uint64_t frame_count_;
+};
+
+// 16-bit mono PCM WAV. The sizes in the header are filled in by Finish when
+// the output can seek; a pipe gets the "unknown length" sizes ffmpeg accepts.
+class AudioCapture {
+public:
+    AudioCapture(const std::string& path, uint32_t sample_rate);
+    void AddSamples(const int16_t* samples, size_t count);
+    void Finish();
+    double GetStallSeconds();
+private:
+    AsyncWriter writer_;
+    uint32_t sample_rate_;
+};
+
+}
@@ -0,0 +1,80 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "cartridge.h"
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include "ines.h"
+#include "state.h"
+
+namespace ozones {
+
+Cartridge::Cartridge(std::istream& rom) {
+    INesHeader header;
+    if(!rom.read((char*) &header, sizeof(header)))
+        throw std::runtime_error("Unexpected EOF in ROM header");
+    if(header.signature != INesHeader::kSignature)
+        throw std::runtime_error("Not an iNES ROM");
+    // Old dumps often carry junk in the last header bytes, upper mapper nibble included
+    bool junk = header.format != 2 && std::any_of(header.various + 4, header.various + 8, [](uint8_t b) { return b != 0; });
+    unsigned mapper = header.mapper_low | (junk ? 0 : header.mapper_high << 4);
+    // The bus maps one fixed 32 KiB PRG window, so only NROM boards can run
+    if(mapper != 0)
+        throw std::runtime_error("Unsupported mapper " + std::to_string(mapper));
+    if(header.prg_rom_size == 0)
+        throw std::runtime_error("ROM has no PRG ROM");
+    if(header.has_trainer && rom.ignore(512).gcount() != 512)
+        throw std::runtime_error("Unexpected EOF in trainer");
+    std::vector<uint8_t> prg(16384 * header.prg_rom_size);
+    if(!rom.read((char*) prg.data(), prg.size()))
+        throw std::runtime_error("Unexpected EOF in PRG ROM");
+    prg_size_ = prg.size();
+    hash_ = HashBytes(kHashBasis, prg.data(), prg.size());
+    prg_rom_ = std::make_shared<Rom>(std::move(prg));
+    chr_ = std::make_shared<std::vector<uint8_t>>(8192 * std::max<size_t>(header.chr_rom_size, 1));
+    if(header.chr_rom_size && !rom.read((char*) chr_->data(), chr_->size()))
+        throw std::runtime_error("Unexpected EOF in CHR ROM");
+    if(header.chr_rom_size)
+        hash_ = HashBytes(hash_, chr_->data(), chr_->size());
+    chr_writable_ = header.chr_rom_size == 0;
+    if(header.ignore_mirroring)
+        mirroring_ = Vram::kFourScreen;
+    else if(header.vertical_mirroring)
+        mirroring_ = Vram::kVertical;
+    else
+        mirroring_ = Vram::kHorizontal;
+    auto bus = std::make_shared<Ram>(2048);
+    bus->Map(prg_rom_, 0x8000, 0, 0x8000);
+    decode_table_ = std::make_shared<DecodeTable>(bus);
+}
+
+std::shared_ptr<Rom> Cartridge::GetPrgRom() {
+    return prg_rom_;
+}
+
+std::shared_ptr<std::vector<uint8_t>> Cartridge::GetChr() {
+    return chr_;
+}
+
+bool Cartridge::IsChrWritable() {
+    return chr_writable_;
+}
+
+Vram::Mirroring Cartridge::GetMirroring() {
+    return mirroring_;
+}
+
+uint64_t Cartridge::GetHash() {
+    return hash_;
+}
+
+std::shared_ptr<const DecodeTable> Cartridge::GetDecodeTable() {
+    return decode_table_;
+}
+
+size_t Cartridge::GetMemoryUsage() {
+    return sizeof(*this) + sizeof(Rom) + prg_size_ + chr_->capacity() + decode_table_->GetMemoryUsage();
+}
+
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <vector>
+#include "decode_table.h"
+#include "rom.h"
+#include "vram.h"
+
+namespace ozones {
+
+// A game loaded from an iNES image: everything about it that never changes
+// while it runs, shared by all the machines playing it
+class Cartridge {
+public:
+    Cartridge(std::istream& rom);
+    std::shared_ptr<Rom> GetPrgRom();
+    // CHR ROM, or the initial contents of CHR RAM which machines copy
+    std::shared_ptr<std::vector<uint8_t>> GetChr();
+    bool IsChrWritable();
+    Vram::Mirroring GetMirroring();
+    uint64_t GetHash();
+    std::shared_ptr<const DecodeTable> GetDecodeTable();
+    size_t GetMemoryUsage();
+private:
+    size_t prg_size_;
+    std::shared_ptr<Rom> prg_rom_;
+    std::shared_ptr<std::vector<uint8_t>> chr_;
+    bool chr_writable_;
+    Vram::Mirroring mirroring_;
+    uint64_t hash_;
+    std::shared_ptr<const DecodeTable> decode_table_;
+};
+
+}
@@ -0,0 +1,329 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "cartridge.h"
+#include "controllers.h"
+#include "filter.h"
+#include "machine.h"
+#include "movie.h"
+#include "palette.h"
+#include "simd.h"
+#include "state.h"
+
+using namespace ozones;
+
+namespace {
+
+// A 32 KiB NROM image with program copied in at $8000 and the reset vector pointing there
+std::string BuildRom(const std::vector<std::pair<uint16_t, std::vector<uint8_t>>>& code) {
+    std::string image(16 + 0x8000 + 0x2000, '\0');
+    image[0] = 'N';
+    image[1] = 'E';
+    image[2] = 'S';
+    image[3] = 0x1A;
+    image[4] = 2;
+    image[5] = 1;
+    for(auto& block : code)
+        std::copy(block.second.begin(), block.second.end(), image.begin() + 16 + (block.first - 0x8000));
+    image[16 + 0x7FFC] = 0x00;
+    image[16 + 0x7FFD] = (char) 0x80;
+    return image;
+}
+
+// Jump-table dispatch through RAM: the pointer at $10 is $9300 while A is
+// held on port 1 and $9234 otherwise, and the targets mark $0300 with $A5
+// or $5A and count their visits in $0301 or $0302
+std::string BuildIndirectJumpRom() {
+    return BuildRom({
+        { 0x8000, {
+            0xA9, 0x01,         // LDA #$01
+            0x8D, 0x16, 0x40,   // STA $4016
+            0xA9, 0x00,         // LDA #$00
+            0x8D, 0x16, 0x40,   // STA $4016
+            0xAD, 0x16, 0x40,   // LDA $4016
+            0x29, 0x01,         // AND #$01
+            0xF0, 0x06,         // BEQ released
+            0xA9, 0x00,         // LDA #$00
+            0xA2, 0x93,         // LDX #$93
+            0xD0, 0x04,         // BNE store
+            0xA9, 0x34,         // released: LDA #$34
+            0xA2, 0x92,         // LDX #$92
+            0x85, 0x10,         // store: STA $10
+            0x86, 0x11,         // STX $11
+            0x6C, 0x10, 0x00    // JMP ($0010)
+        } },
+        { 0x9234, {
+            0xA9, 0x5A,         // LDA #$5A
+            0x8D, 0x00, 0x03,   // STA $0300
+            0xEE, 0x01, 0x03,   // INC $0301
+            0x4C, 0x00, 0x80    // JMP $8000
+        } },
+        { 0x9300, {
+            0xA9, 0xA5,         // LDA #$A5
+            0x8D, 0x00, 0x03,   // STA $0300
+            0xEE, 0x02, 0x03,   // INC $0302
+            0x4C, 0x00, 0x80    // JMP $8000
+        } }
+    });
+}
+
+// JMP ($nnnn) with the pointer in RAM must follow the pointer as it is when the jump runs
+bool CheckIndirectJump() {
+    std::istringstream rom(BuildIndirectJumpRom());
+    Machine machine(rom);
+    machine.SetAudioEnabled(false);
+    machine.RunFrame(Ppu::kRenderTimingOnly);
+    if(machine.GetRam()[0x300] != 0x5A || machine.GetRam()[0x301] == 0)
+        return false;
+    machine.SetButtons(0, Controllers::kA);
+    machine.RunFrame(Ppu::kRenderTimingOnly);
+    return machine.GetRam()[0x300] == 0xA5 && machine.GetRam()[0x302] != 0;
+}
+
+// Noise in the short mode at volume 15, silenced through its length counter
+// unless A is held on port 1
+std::string BuildNoiseRom() {
+    return BuildRom({
+        { 0x8000, {
+            0xA9, 0x3F,         // LDA #$3F
+            0x8D, 0x0C, 0x40,   // STA $400C
+            0xA9, 0x83,         // LDA #$83
+            0x8D, 0x0E, 0x40,   // STA $400E
+            0xA9, 0x01,         // loop: LDA #$01
+            0x8D, 0x16, 0x40,   // STA $4016
+            0xA9, 0x00,         // LDA #$00
+            0x8D, 0x16, 0x40,   // STA $4016
+            0xAD, 0x16, 0x40,   // LDA $4016
+            0x29, 0x01,         // AND #$01
+            0xAA,               // TAX
+            0xBD, 0x00, 0x90,   // LDA $9000,X
+            0x8D, 0x15, 0x40,   // STA $4015
+            0xA9, 0xF8,         // LDA #$F8
+            0x8D, 0x0F, 0x40,   // STA $400F
+            0x4C, 0x0A, 0x80    // JMP loop
+        } },
+        { 0x9000, { 0x00, 0x08 } }
+    });
+}
+
+// The noise shift register keeps clocking while muted, so a channel that was
+// silent ends up in the same state as one that played all along
+bool CheckMutedNoise() {
+    const int kFrames = 10;
+    std::string image = BuildNoiseRom();
+    std::vector<uint64_t> hashes;
+    for(bool muted : { true, false }) {
+        std::istringstream rom(image);
+        Machine machine(rom);
+        machine.SetAudioEnabled(false);
+        for(int frame = 0; frame <= kFrames; ++frame) {
+            machine.SetButtons(0, muted && frame < kFrames ? 0 : Controllers::kA);
+            machine.RunFrame(Ppu::kRenderTimingOnly);
+        }
+        hashes.push_back(machine.GetStateHash());
+    }
+    return hashes[0] == hashes[1];
+}
+
+// A movie whose recording ran one frame on another input than it stored must
+// report that very frame, not the end of its hash block
+bool CheckMovieDivergence() {
+    const uint64_t kFrames = 150;
+    const uint64_t kWrongFrame = 100;
+    char path[] = "/tmp/ozones-check-XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0)
+        return false;
+    close(fd);
+    std::string image = BuildIndirectJumpRom();
+    int64_t diverged;
+    {
+        std::istringstream rom(image);
+        Machine machine(rom);
+        MovieWriter writer(path, machine.GetRomHash());
+        for(uint64_t frame = 0; frame < kFrames; ++frame) {
+            machine.SetButtons(0, frame == kWrongFrame ? Controllers::kA : 0);
+            machine.RunFrame(Ppu::kRenderTimingOnly);
+            writer.AddFrame(0, machine);
+        }
+        writer.Finish();
+        std::istringstream replay_rom(image);
+        Machine replay(replay_rom);
+        diverged = MovieReader(path).Play(replay);
+    }
+    unlink(path);
+    return diverged == (int64_t) kWrongFrame;
+}
+
+// Broken or unsupported images must be refused with an exception rather
+// than crash the host, and a trainer must be skipped
+bool CheckMalformedRom() {
+    std::string image = BuildIndirectJumpRom();
+    std::string bad_magic = image;
+    bad_magic[3] = 0;
+    std::string no_prg = image.substr(0, 16);
+    no_prg[4] = 0;
+    no_prg[5] = 0;
+    std::string mapper = image;
+    mapper[6] = 0x10;
+    std::string truncated = image.substr(0, 16 + 0x4000);
+    for(const std::string& broken : { bad_magic, no_prg, mapper, truncated }) {
+        try {
+            std::istringstream rom(broken);
+            Cartridge cartridge(rom);
+            return false;
+        } catch(std::runtime_error&) {
+        }
+    }
+    std::string trainer = image;
+    trainer[6] = 0x04;
+    trainer.insert(16, 512, (char) 0xEA);
+    std::istringstream rom(image), trainer_rom(trainer);
+    return Cartridge(rom).GetHash() == Cartridge(trainer_rom).GetHash();
+}
+
+// A frame count forged so the size check would wrap around must be refused
+bool CheckForgedMovie() {
+    char path[] = "/tmp/ozones-check-XXXXXX";
+    int fd = mkstemp(path);
+    if(fd < 0)
+        return false;
+    MovieHeader header = {};
+    header.magic = MovieHeader::kMagic;
+    header.version = MovieHeader::kVersion;
+    header.hash_interval = 1;
+    // 6 bytes per frame plus an 8-byte hash each: 14 * frame_count wraps to 12
+    header.frame_count = (UINT64_MAX - 1) / 14 + 1;
+    std::vector<uint8_t> data(sizeof(header) + 64);
+    std::memcpy(data.data(), &header, sizeof(header));
+    bool written = write(fd, data.data(), data.size()) == (ssize_t) data.size();
+    close(fd);
+    bool refused = false;
+    try {
+        MovieReader movie(path);
+    } catch(std::runtime_error&) {
+        refused = true;
+    }
+    unlink(path);
+    return written && refused;
+}
+
+// A delta cut short or with its page bitmap forged must be refused without
+// reading past its end or changing the machine, and a whole one must apply
+bool CheckStateDelta() {
+    std::istringstream rom(BuildIndirectJumpRom());
+    Machine machine(rom);
+    machine.SetAudioEnabled(false);
+    std::vector<uint8_t> base, delta;
+    uint32_t epoch = machine.SaveState(base);
+    for(int frame = 0; frame < 5; ++frame)
+        machine.RunFrame(Ppu::kRenderTimingOnly);
+    uint64_t expected = machine.GetStateHash();
+    machine.SaveStateDelta(delta, epoch);
+    machine.LoadState(base);
+    uint64_t before = machine.GetStateHash();
+    std::vector<uint8_t> truncated(delta.begin(), delta.end() - 1);
+    StateHeader header;
+    std::memcpy(&header, truncated.data(), sizeof(header));
+    header.size = truncated.size() - sizeof(header);
+    std::memcpy(truncated.data(), &header, sizeof(header));
+    // The RAM bitmap follows the CPU registers; select every page
+    std::vector<uint8_t> forged = delta;
+    StateWriter counter(nullptr);
+    machine.GetCpu()->SaveState(counter);
+    std::memset(forged.data() + sizeof(header) + counter.GetSize(), 0xFF, sizeof(uint64_t));
+    for(auto& broken : { truncated, forged }) {
+        try {
+            machine.LoadStateDelta(broken);
+            return false;
+        } catch(std::runtime_error&) {
+        }
+        if(machine.GetStateHash() != before)
+            return false;
+    }
+    machine.LoadStateDelta(delta);
+    return machine.GetStateHash() == expected;
+}
+
+// The AVX2 palette conversion must give exactly the scalar one's RGBA for
+// any indices, every greyscale and emphasis setting and widths with a tail
+bool CheckPaletteSimd() {
+    std::mt19937 random(1);
+    std::vector<uint8_t> indices(Ppu::kScreenWidth);
+    std::vector<uint32_t> simd(indices.size()), scalar(indices.size());
+    bool passed = true;
+    for(int mask = 0; mask < 256; ++mask) {
+        for(auto& index : indices)
+            index = (uint8_t) random();
+        for(int width : { Ppu::kScreenWidth, 61 }) {
+            Palette::ConvertScanline(indices.data(), (uint8_t) mask, simd.data(), width);
+            SetAvx2Enabled(false);
+            Palette::ConvertScanline(indices.data(), (uint8_t) mask, scalar.data(), width);
+            SetAvx2Enabled(true);
+            passed &= std::equal(simd.begin(), simd.begin() + width, scalar.begin());
+        }
+    }
+    return passed;
+}
+
+// Every filter's AVX2 path must give exactly the output of its scalar one;
+// pixels come from a small palette so the edge-based scalers see equal neighbours
+bool CheckFilterSimd() {
+    const int kWidth = 61;
+    const int kHeight = 9;
+    std::mt19937 random(1);
+    std::vector<uint32_t> palette(4);
+    for(auto& color : palette)
+        color = random();
+    std::vector<uint32_t> image(kWidth * kHeight);
+    for(auto& pixel : image)
+        pixel = palette[random() % palette.size()];
+    bool passed = true;
+    for(Filter::Type type : { Filter::kNearest, Filter::kScale2x, Filter::kScale3x, Filter::kEdgeDirected, Filter::kNtscBlur }) {
+        Filter filter(type, 2, 1);
+        size_t size = kWidth * kHeight * filter.GetScale() * filter.GetScale();
+        std::vector<uint32_t> simd(size), scalar(size);
+        filter.Apply(image.data(), kWidth, kHeight, simd.data());
+        SetAvx2Enabled(false);
+        filter.Apply(image.data(), kWidth, kHeight, scalar.data());
+        SetAvx2Enabled(true);
+        passed &= simd == scalar;
+    }
+    return passed;
+}
+
+}
+
+int main()
+{
+    // ozones-check runs every check and fails if any of them does
+    const std::vector<std::pair<std::string, std::function<bool()>>> kChecks = {
+        { "indirect jump through RAM", CheckIndirectJump },
+        { "noise keeps its phase while muted", CheckMutedNoise },
+        { "movie divergence frame", CheckMovieDivergence },
+        { "forged movie frame count", CheckForgedMovie },
+        { "malformed ROMs are refused", CheckMalformedRom },
+        { "broken state deltas are refused", CheckStateDelta },
+        { "palette AVX2 path matches scalar", CheckPaletteSimd },
+        { "filter AVX2 paths match scalar", CheckFilterSimd }
+    };
+    bool passed = true;
+    for(auto& check : kChecks) {
+        bool result = check.second();
+        std::cout << (result ? "pass: " : "FAIL: ") << check.first << std::endl;
+        passed &= result;
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,49 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "controllers.h"
+
+namespace ozones {
+
+Controllers::Controllers(std::shared_ptr<Mappable> apu) : apu_(apu), buttons_(), shift_(), strobe_(false) { }
+
+uint8_t Controllers::ReadByte(size_t addr) {
+    size_t port = addr & 1;
+    if(strobe_)
+        shift_[port] = buttons_[port];
+    uint8_t bit = shift_[port] & 1;
+    // Official controllers return 1 once all eight buttons have been read
+    shift_[port] = (shift_[port] >> 1) | 0x80;
+    // The upper bits are open bus, which is usually the $40 of the address
+    return 0x40 | bit;
+}
+
+void Controllers::WriteByte(size_t addr, uint8_t value) {
+    if(addr == 0x4017) {
+        apu_->WriteByte(addr, value);
+        return;
+    }
+    strobe_ = value & 1;
+    if(strobe_)
+        shift_ = buttons_;
+}
+
+void Controllers::SetButtons(size_t port, uint8_t buttons) {
+    buttons_[port] = buttons;
+}
+
+uint8_t Controllers::GetButtons(size_t port) {
+    return buttons_[port];
+}
+
+void Controllers::SaveState(StateWriter& writer) {
+    writer.Write(shift_);
+    writer.Write(strobe_);
+}
+
+void Controllers::LoadState(StateReader& reader) {
+    reader.Read(shift_);
+    reader.Read(strobe_);
+}
+
+}
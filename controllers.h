@@ -0,0 +1,41 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include "ram.h"
+#include "state.h"
+
+namespace ozones {
+
+// Two standard controllers on $4016/$4017. $4017 writes belong to the APU
+// frame counter and are passed through to it.
+class Controllers : public Mappable {
+public:
+    enum Button {
+        kA      = 0x01,
+        kB      = 0x02,
+        kSelect = 0x04,
+        kStart  = 0x08,
+        kUp     = 0x10,
+        kDown   = 0x20,
+        kLeft   = 0x40,
+        kRight  = 0x80
+    };
+    Controllers(std::shared_ptr<Mappable> apu);
+    uint8_t ReadByte(size_t addr) override;
+    void WriteByte(size_t addr, uint8_t value) override;
+    // Buttons currently held on port 0 or 1, as a mask of Button values
+    void SetButtons(size_t port, uint8_t buttons);
+    uint8_t GetButtons(size_t port);
+    // Shift registers and strobe; held buttons are input and not included
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+private:
+    std::shared_ptr<Mappable> apu_;
+    std::array<uint8_t, 2> buttons_;
+    std::array<uint8_t, 2> shift_;
+    bool strobe_;
+};
+
+}
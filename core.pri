@@ -0,0 +1,64 @@
+# Emulation core shared by the frontend and the headless tools; no SFML in here
+
+SOURCES += \
+    $$PWD/ram.cpp \
+    $$PWD/instruction.cpp \
+    $$PWD/cpu.cpp \
+    $$PWD/rom.cpp \
+    $$PWD/ppu.cpp \
+    $$PWD/vram.cpp \
+    $$PWD/machine.cpp \
+    $$PWD/renderer.cpp \
+    $$PWD/palette.cpp \
+    $$PWD/thread_pool.cpp \
+    $$PWD/blip_buffer.cpp \
+    $$PWD/apu.cpp \
+    $$PWD/resampler.cpp \
+    $$PWD/controllers.cpp \
+    $$PWD/mapped_file.cpp \
+    $$PWD/run_length.cpp \
+    $$PWD/rewind_buffer.cpp \
+    $$PWD/movie.cpp \
+    $$PWD/work_stealing_pool.cpp \
+    $$PWD/branch_search.cpp \
+    $$PWD/machine_pool.cpp \
+    $$PWD/decode_table.cpp \
+    $$PWD/cartridge.cpp \
+    $$PWD/async_writer.cpp \
+    $$PWD/capture.cpp \
+    $$PWD/netplay_transport.cpp \
+    $$PWD/rollback_session.cpp
+
+HEADERS += \
+    $$PWD/ram.h \
+    $$PWD/instruction.h \
+    $$PWD/cpu.h \
+    $$PWD/rom.h \
+    $$PWD/ines.h \
+    $$PWD/ppu.h \
+    $$PWD/vram.h \
+    $$PWD/machine.h \
+    $$PWD/renderer.h \
+    $$PWD/palette.h \
+    $$PWD/thread_pool.h \
+    $$PWD/blip_buffer.h \
+    $$PWD/apu.h \
+    $$PWD/spsc_ring.h \
+    $$PWD/resampler.h \
+    $$PWD/state.h \
+    $$PWD/page_tracker.h \
+    $$PWD/controllers.h \
+    $$PWD/mapped_file.h \
+    $$PWD/run_length.h \
+    $$PWD/rewind_buffer.h \
+    $$PWD/movie.h \
+    $$PWD/work_stealing_pool.h \
+    $$PWD/branch_search.h \
+    $$PWD/machine_pool.h \
+    $$PWD/decode_table.h \
+    $$PWD/cartridge.h \
+    $$PWD/async_writer.h \
+    $$PWD/capture.h \
+    $$PWD/netplay_transport.h \
+    $$PWD/rollback_session.h \
+    $$PWD/simd.h
@@ -8,16 +8,19 @@
 
 namespace ozones {
 
-Cpu::Cpu(std::shared_ptr<Ram> ram) : reg_a_(0), reg_x_(0), reg_y_(0), reg_sp_(0xFD), reg_p_(0x24), reg_pc_(ram->ReadWord(0xFFFC)), cycle_counter_(0), ram_(ram), nmi_pending_(false) { }
+Cpu::Cpu(std::shared_ptr<Ram> ram, std::shared_ptr<const DecodeTable> decode_table) : reg_a_(0), reg_x_(0), reg_y_(0), reg_sp_(0xFD), reg_p_(0x24), reg_pc_(ram->ReadWord(0xFFFC)), cycle_counter_(0), tick_cycles_(0), trace_(nullptr), ram_(ram), decode_table_(decode_table), nmi_pending_(false), irq_pending_(false) { }
 
-void Cpu::Tick() {
-    Instruction instr(ram_, reg_pc_);
-    std::cout << std::hex << reg_pc_;
-    for(size_t i = 0; i < instr.GetLength(); i++) {
-        std::cout << std::hex << " " << (int) ram_->ReadByte(reg_pc_ + i);
+int Cpu::Tick() {
+    tick_cycles_ = 0;
+    Instruction instr = Decode();
+    if(trace_) {
+        *trace_ << std::hex << reg_pc_;
+        for(size_t i = 0; i < instr.GetLength(); i++) {
+            *trace_ << std::hex << " " << (int) ram_->ReadByte(reg_pc_ + i);
+        }
+        *trace_ << std::hex << " A:" << (int) reg_a_ << " X:" << (int) reg_x_ << " Y:" << (int) reg_y_ << " P:" << (int) reg_p_ << " SP:" << (int) reg_sp_;
+        *trace_ << std::dec << " CYC: " << cycle_counter_ << std::endl;
     }
-    std::cout << std::hex << " A:" << (int) reg_a_ << " X:" << (int) reg_x_ << " Y:" << (int) reg_y_ << " P:" << (int) reg_p_ << " SP:" << (int) reg_sp_;
-    std::cout << std::dec << " CYC: " << cycle_counter_ << std::endl;
     TakeCycles(instr.GetCycles() - 1);
     reg_pc_ += instr.GetLength();
     ExecuteInstruction(instr);
@@ -26,6 +29,17 @@ void Cpu::Tick() {
         TriggerNmi();
     if(!(reg_p_ & kInterruptDisable) && irq_pending_)
         TriggerIrq();
+    return tick_cycles_;
+}
+
+Instruction Cpu::Decode() {
+    if(decode_table_ && decode_table_->Contains(reg_pc_))
+        return decode_table_->Get(reg_pc_);
+    return Instruction(ram_, reg_pc_);
+}
+
+void Cpu::SetTraceStream(std::ostream* trace) {
+    trace_ = trace;
 }
 
 void Cpu::SetNmiPending(bool nmi_pending) {
@@ -36,6 +50,38 @@ void Cpu::SetIrqPending(bool irq_pending) {
     irq_pending_ = irq_pending;
 }
 
+void Cpu::Reset() {
+    reg_sp_ -= 3;
+    SetFlag(kInterruptDisable, true);
+    reg_pc_ = ram_->ReadWord(0xFFFC);
+    nmi_pending_ = false;
+    irq_pending_ = false;
+}
+
+void Cpu::SaveState(StateWriter& writer) {
+    writer.Write(reg_a_);
+    writer.Write(reg_x_);
+    writer.Write(reg_y_);
+    writer.Write(reg_sp_);
+    writer.Write(reg_p_);
+    writer.Write(reg_pc_);
+    writer.Write(cycle_counter_);
+    writer.Write(nmi_pending_);
+    writer.Write(irq_pending_);
+}
+
+void Cpu::LoadState(StateReader& reader) {
+    reader.Read(reg_a_);
+    reader.Read(reg_x_);
+    reader.Read(reg_y_);
+    reader.Read(reg_sp_);
+    reader.Read(reg_p_);
+    reader.Read(reg_pc_);
+    reader.Read(cycle_counter_);
+    reader.Read(nmi_pending_);
+    reader.Read(irq_pending_);
+}
+
 void Cpu::ExecuteInstruction(Instruction instruction) {
     switch(instruction.GetMnemonic()) {
     // Official
@@ -525,6 +571,7 @@ uint16_t Cpu::PullWord() {
 }
 
 void Cpu::TakeCycles(int n) {
+    tick_cycles_ += n;
     cycle_counter_ += 3 * n;
     cycle_counter_ %= 341;
 }
@@ -533,7 +580,9 @@ void Cpu::TriggerNmi() {
     PushWord(reg_pc_);
     PushByte(reg_p_);
     reg_pc_ = ram_->ReadWord(0xFFFA);
+    SetFlag(kInterruptDisable, true);
     nmi_pending_ = false;
+    TakeCycles(7);
 }
 
 void Cpu::TriggerIrq() {
@@ -541,6 +590,7 @@ void Cpu::TriggerIrq() {
     PushByte(reg_p_);
     SetFlag(kInterruptDisable, true);
     reg_pc_ = ram_->ReadWord(0xFFFE);
+    TakeCycles(7);
 }
 
 }
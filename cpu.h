@@ -2,17 +2,28 @@
 
 #include <cstdint>
 #include <memory>
+#include <ostream>
+#include "decode_table.h"
 #include "instruction.h"
 #include "ram.h"
+#include "state.h"
 
 namespace ozones {
 
 class Cpu {
 public:
-    Cpu(std::shared_ptr<Ram> ram);
-    void Tick();
+    // Instructions in PRG ROM come from decode_table when one is given
+    Cpu(std::shared_ptr<Ram> ram, std::shared_ptr<const DecodeTable> decode_table = nullptr);
+    // Executes one instruction and returns the number of CPU cycles it took
+    int Tick();
+    // Writes a nestest-style log line per instruction when non-null
+    void SetTraceStream(std::ostream* trace);
     void SetNmiPending(bool nmi_pending);
     void SetIrqPending(bool irq_pending);
+    // The reset line: SP drops by 3, interrupts are disabled and execution restarts at the reset vector
+    void Reset();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
 private:
     enum StatusFlag {
         kCarry              = 0x01,
@@ -27,9 +38,13 @@ private:
     uint8_t reg_a_, reg_x_, reg_y_, reg_sp_, reg_p_;
     uint16_t reg_pc_;
     int cycle_counter_;
+    int tick_cycles_;
+    std::ostream* trace_;
     std::shared_ptr<Ram> ram_;
+    std::shared_ptr<const DecodeTable> decode_table_;
     bool nmi_pending_;
     bool irq_pending_;
+    Instruction Decode();
     void ExecuteInstruction(Instruction instruction);
     uint16_t OperandRead(Operand operand);
     void OperandWrite(Operand operand, uint8_t value);
@@ -0,0 +1,32 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "decode_table.h"
+#include <stdexcept>
+
+namespace ozones {
+
+DecodeTable::DecodeTable(std::shared_ptr<Ram> ram) : instructions_(kEnd - kStart + 1), valid_(kEnd - kStart + 1) {
+    // Data bytes decode too; an unknown opcode throws once and is skipped after that
+    std::array<bool, 256> unknown = {};
+    for(size_t addr = kStart; addr <= kEnd; ++addr) {
+        uint8_t opcode = ram->ReadByte(addr);
+        if(unknown[opcode])
+            continue;
+        // JMP ($nnnn) resolves its pointer while decoding; through RAM it must be decoded when it runs
+        if(opcode == 0x6C && ram->ReadWord(addr + 1) < kStart)
+            continue;
+        try {
+            instructions_[addr - kStart] = Instruction(ram, addr);
+            valid_[addr - kStart] = true;
+        } catch(std::runtime_error&) {
+            unknown[opcode] = true;
+        }
+    }
+}
+
+size_t DecodeTable::GetMemoryUsage() const {
+    return sizeof(*this) + instructions_.capacity() * sizeof(Instruction) + valid_.capacity();
+}
+
+}
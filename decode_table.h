@@ -0,0 +1,36 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "instruction.h"
+#include "ram.h"
+
+namespace ozones {
+
+// Every instruction in PRG ROM decoded up front. It never changes while
+// the PRG ROM isn't bank switched, so machines running the same cartridge
+// share a single table. Only decodes that read nothing but PRG ROM are
+// kept, so JMP ($nnnn) with its pointer in RAM is left out.
+class DecodeTable {
+public:
+    static const uint16_t kStart = 0x8000;
+    // The last address whose whole instruction still lies in ROM
+    static const uint16_t kEnd = 0xFFFD;
+    // Decodes through ram, which must have the PRG ROM mapped at kStart
+    DecodeTable(std::shared_ptr<Ram> ram);
+    // Whether addr lies in ROM and holds a known opcode that decodes the same on every machine
+    bool Contains(uint16_t addr) const {
+        return addr >= kStart && addr <= kEnd && valid_[addr - kStart];
+    }
+    const Instruction& Get(uint16_t addr) const {
+        return instructions_[addr - kStart];
+    }
+    size_t GetMemoryUsage() const;
+private:
+    std::vector<Instruction> instructions_;
+    std::vector<uint8_t> valid_;
+};
+
+}
@@ -0,0 +1,333 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "filter.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <immintrin.h>
+#include <vector>
+#include "simd.h"
+
+namespace ozones {
+
+namespace {
+
+void NearestRowScalar(const uint32_t* in, int width, int scale, uint32_t* out) {
+    for(int x = 0; x < width; ++x)
+        std::fill_n(&out[x * scale], scale, in[x]);
+}
+
+__attribute__((target("avx2")))
+void NearestRow2xAvx2(const uint32_t* in, int width, uint32_t* out) {
+    int x = 0;
+    for(; x + 8 <= width; x += 8) {
+        __m256i pixels = _mm256_loadu_si256((const __m256i*) &in[x]);
+        __m256i low = _mm256_unpacklo_epi32(pixels, pixels);
+        __m256i high = _mm256_unpackhi_epi32(pixels, pixels);
+        _mm256_storeu_si256((__m256i*) &out[2 * x], _mm256_permute2x128_si256(low, high, 0x20));
+        _mm256_storeu_si256((__m256i*) &out[2 * x + 8], _mm256_permute2x128_si256(low, high, 0x31));
+    }
+    NearestRowScalar(in + x, width - x, 2, out + 2 * x);
+}
+
+void NearestRow(const uint32_t* in, int width, int scale, uint32_t* out) {
+    if(scale == 2 && HasAvx2())
+        NearestRow2xAvx2(in, width, out);
+    else
+        NearestRowScalar(in, width, scale, out);
+}
+
+// Scale2x/Scale3x neighbourhood:  A B C
+//                                 D E F
+//                                 G H I
+void Scale2xScalar(const uint32_t* up, const uint32_t* row, const uint32_t* down, int width, int first, int last, uint32_t* out0, uint32_t* out1) {
+    for(int x = first; x < last; ++x) {
+        uint32_t b = up[x], d = row[std::max(x - 1, 0)], e = row[x], f = row[std::min(x + 1, width - 1)], h = down[x];
+        uint32_t e0 = e, e1 = e, e2 = e, e3 = e;
+        if(b != h && d != f) {
+            e0 = d == b ? d : e;
+            e1 = b == f ? f : e;
+            e2 = d == h ? d : e;
+            e3 = h == f ? f : e;
+        }
+        out0[2 * x] = e0;
+        out0[2 * x + 1] = e1;
+        out1[2 * x] = e2;
+        out1[2 * x + 1] = e3;
+    }
+}
+
+__attribute__((target("avx2")))
+inline __m256i Select(__m256i mask, __m256i if_set, __m256i otherwise) {
+    return _mm256_blendv_epi8(otherwise, if_set, mask);
+}
+
+// Interleaves two 8-pixel vectors into 16 consecutive pixels
+__attribute__((target("avx2")))
+inline void StoreInterleaved2(uint32_t* out, __m256i a, __m256i b) {
+    __m256i low = _mm256_unpacklo_epi32(a, b);
+    __m256i high = _mm256_unpackhi_epi32(a, b);
+    _mm256_storeu_si256((__m256i*) out, _mm256_permute2x128_si256(low, high, 0x20));
+    _mm256_storeu_si256((__m256i*) (out + 8), _mm256_permute2x128_si256(low, high, 0x31));
+}
+
+// Interleaves three 8-pixel vectors into 24 consecutive pixels: output
+// pixel g comes from lane g / 3 of vector g % 3
+__attribute__((target("avx2")))
+inline void StoreInterleaved3(uint32_t* out, __m256i a, __m256i b, __m256i c) {
+    const __m256i lanes[3] = {
+        _mm256_setr_epi32(0, 0, 0, 1, 1, 1, 2, 2),
+        _mm256_setr_epi32(2, 3, 3, 3, 4, 4, 4, 5),
+        _mm256_setr_epi32(5, 5, 6, 6, 6, 7, 7, 7)
+    };
+    __m256i a0 = _mm256_permutevar8x32_epi32(a, lanes[0]), b0 = _mm256_permutevar8x32_epi32(b, lanes[0]), c0 = _mm256_permutevar8x32_epi32(c, lanes[0]);
+    __m256i a1 = _mm256_permutevar8x32_epi32(a, lanes[1]), b1 = _mm256_permutevar8x32_epi32(b, lanes[1]), c1 = _mm256_permutevar8x32_epi32(c, lanes[1]);
+    __m256i a2 = _mm256_permutevar8x32_epi32(a, lanes[2]), b2 = _mm256_permutevar8x32_epi32(b, lanes[2]), c2 = _mm256_permutevar8x32_epi32(c, lanes[2]);
+    _mm256_storeu_si256((__m256i*) out, _mm256_blend_epi32(_mm256_blend_epi32(a0, b0, 0x92), c0, 0x24));
+    _mm256_storeu_si256((__m256i*) (out + 8), _mm256_blend_epi32(_mm256_blend_epi32(a1, b1, 0x24), c1, 0x49));
+    _mm256_storeu_si256((__m256i*) (out + 16), _mm256_blend_epi32(_mm256_blend_epi32(a2, b2, 0x49), c2, 0x92));
+}
+
+__attribute__((target("avx2")))
+void Scale2xAvx2(const uint32_t* up, const uint32_t* row, const uint32_t* down, int width, uint32_t* out0, uint32_t* out1) {
+    // Interior only, so x - 1 and x + 8 stay inside the row
+    int x = 1;
+    for(; x + 9 <= width; x += 8) {
+        __m256i b = _mm256_loadu_si256((const __m256i*) &up[x]);
+        __m256i d = _mm256_loadu_si256((const __m256i*) &row[x - 1]);
+        __m256i e = _mm256_loadu_si256((const __m256i*) &row[x]);
+        __m256i f = _mm256_loadu_si256((const __m256i*) &row[x + 1]);
+        __m256i h = _mm256_loadu_si256((const __m256i*) &down[x]);
+        __m256i edge = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(b, h), _mm256_cmpeq_epi32(d, f)), _mm256_set1_epi32(-1));
+        __m256i e0 = Select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(d, b)), d, e);
+        __m256i e1 = Select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(b, f)), f, e);
+        __m256i e2 = Select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(d, h)), d, e);
+        __m256i e3 = Select(_mm256_and_si256(edge, _mm256_cmpeq_epi32(h, f)), f, e);
+        StoreInterleaved2(&out0[2 * x], e0, e1);
+        StoreInterleaved2(&out1[2 * x], e2, e3);
+    }
+    Scale2xScalar(up, row, down, width, 0, 1, out0, out1);
+    Scale2xScalar(up, row, down, width, x, width, out0, out1);
+}
+
+void Scale3xScalar(const uint32_t* up, const uint32_t* row, const uint32_t* down, int width, int first, int last, uint32_t* out0, uint32_t* out1, uint32_t* out2) {
+    for(int x = first; x < last; ++x) {
+        int left = std::max(x - 1, 0), right = std::min(x + 1, width - 1);
+        uint32_t a = up[left], b = up[x], c = up[right];
+        uint32_t d = row[left], e = row[x], f = row[right];
+        uint32_t g = down[left], h = down[x], i = down[right];
+        uint32_t o[9] = { e, e, e, e, e, e, e, e, e };
+        if(b != h && d != f) {
+            o[0] = d == b ? d : e;
+            o[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+            o[2] = b == f ? f : e;
+            o[3] = (d == b && e != g) || (d == h && e != a) ? d : e;
+            o[5] = (b == f && e != i) || (h == f && e != c) ? f : e;
+            o[6] = d == h ? d : e;
+            o[7] = (d == h && e != i) || (h == f && e != g) ? h : e;
+            o[8] = h == f ? f : e;
+        }
+        std::copy_n(&o[0], 3, &out0[3 * x]);
+        std::copy_n(&o[3], 3, &out1[3 * x]);
+        std::copy_n(&o[6], 3, &out2[3 * x]);
+    }
+}
+
+__attribute__((target("avx2")))
+void Scale3xAvx2(const uint32_t* up, const uint32_t* row, const uint32_t* down, int width, uint32_t* out0, uint32_t* out1, uint32_t* out2) {
+    int x = 1;
+    for(; x + 9 <= width; x += 8) {
+        __m256i a = _mm256_loadu_si256((const __m256i*) &up[x - 1]);
+        __m256i b = _mm256_loadu_si256((const __m256i*) &up[x]);
+        __m256i c = _mm256_loadu_si256((const __m256i*) &up[x + 1]);
+        __m256i d = _mm256_loadu_si256((const __m256i*) &row[x - 1]);
+        __m256i e = _mm256_loadu_si256((const __m256i*) &row[x]);
+        __m256i f = _mm256_loadu_si256((const __m256i*) &row[x + 1]);
+        __m256i g = _mm256_loadu_si256((const __m256i*) &down[x - 1]);
+        __m256i h = _mm256_loadu_si256((const __m256i*) &down[x]);
+        __m256i i = _mm256_loadu_si256((const __m256i*) &down[x + 1]);
+        __m256i edge = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpeq_epi32(b, h), _mm256_cmpeq_epi32(d, f)), _mm256_set1_epi32(-1));
+        __m256i db = _mm256_and_si256(edge, _mm256_cmpeq_epi32(d, b));
+        __m256i bf = _mm256_and_si256(edge, _mm256_cmpeq_epi32(b, f));
+        __m256i dh = _mm256_and_si256(edge, _mm256_cmpeq_epi32(d, h));
+        __m256i hf = _mm256_and_si256(edge, _mm256_cmpeq_epi32(h, f));
+        __m256i ea = _mm256_cmpeq_epi32(e, a), ec = _mm256_cmpeq_epi32(e, c);
+        __m256i eg = _mm256_cmpeq_epi32(e, g), ei = _mm256_cmpeq_epi32(e, i);
+        __m256i o0 = Select(db, d, e);
+        __m256i o1 = Select(_mm256_or_si256(_mm256_andnot_si256(ec, db), _mm256_andnot_si256(ea, bf)), b, e);
+        __m256i o2 = Select(bf, f, e);
+        __m256i o3 = Select(_mm256_or_si256(_mm256_andnot_si256(eg, db), _mm256_andnot_si256(ea, dh)), d, e);
+        __m256i o5 = Select(_mm256_or_si256(_mm256_andnot_si256(ei, bf), _mm256_andnot_si256(ec, hf)), f, e);
+        __m256i o6 = Select(dh, d, e);
+        __m256i o7 = Select(_mm256_or_si256(_mm256_andnot_si256(ei, dh), _mm256_andnot_si256(eg, hf)), h, e);
+        __m256i o8 = Select(hf, f, e);
+        StoreInterleaved3(&out0[3 * x], o0, o1, o2);
+        StoreInterleaved3(&out1[3 * x], o3, e, o5);
+        StoreInterleaved3(&out2[3 * x], o6, o7, o8);
+    }
+    Scale3xScalar(up, row, down, width, 0, 1, out0, out1, out2);
+    Scale3xScalar(up, row, down, width, x, width, out0, out1, out2);
+}
+
+// Perceptual-ish colour distance used by the edge-directed filter
+int Distance(uint32_t p, uint32_t q) {
+    int r = std::abs((int) (p & 0xFF) - (int) (q & 0xFF));
+    int g = std::abs((int) ((p >> 8) & 0xFF) - (int) ((q >> 8) & 0xFF));
+    int b = std::abs((int) ((p >> 16) & 0xFF) - (int) ((q >> 16) & 0xFF));
+    return 2 * r + 4 * g + b;
+}
+
+uint32_t Average(uint32_t p, uint32_t q) {
+    return (p & q) + (((p ^ q) & 0xFEFEFEFE) >> 1);
+}
+
+// 2x edge-directed interpolation in the spirit of xBR level 1: a corner is
+// smoothed when the two neighbours sharing it form an edge that E is not part
+// of and that edge is stronger than the one through the diagonal neighbour
+uint32_t EdgeCorner(uint32_t e, uint32_t side1, uint32_t side2, uint32_t diagonal) {
+    const int kSimilar = 48;
+    if(Distance(side1, side2) >= kSimilar || Distance(e, side1) < kSimilar)
+        return e;
+    if(Distance(e, diagonal) + Distance(side1, side2) > Distance(side1, diagonal) + Distance(side2, diagonal) + Distance(e, side1))
+        return e;
+    return Average(e, Average(side1, side2));
+}
+
+void EdgeDirectedRow(const uint32_t* up, const uint32_t* row, const uint32_t* down, int width, uint32_t* out0, uint32_t* out1) {
+    for(int x = 0; x < width; ++x) {
+        int left = std::max(x - 1, 0), right = std::min(x + 1, width - 1);
+        uint32_t e = row[x];
+        out0[2 * x] = EdgeCorner(e, row[left], up[x], up[left]);
+        out0[2 * x + 1] = EdgeCorner(e, up[x], row[right], up[right]);
+        out1[2 * x] = EdgeCorner(e, row[left], down[x], down[left]);
+        out1[2 * x + 1] = EdgeCorner(e, down[x], row[right], down[right]);
+    }
+}
+
+// Horizontal 1-2-1 blur of each channel approximating composite video bandwidth
+void BlurRowScalar(const uint32_t* in, int width, int first, int last, uint32_t* out) {
+    for(int x = first; x < last; ++x)
+        out[x] = Average(in[x], Average(in[std::max(x - 1, 0)], in[std::min(x + 1, width - 1)]));
+}
+
+// Per-byte average rounded down like Average; _mm256_avg_epu8 alone rounds up
+__attribute__((target("avx2")))
+__m256i AverageAvx2(__m256i a, __m256i b) {
+    return _mm256_sub_epi8(_mm256_avg_epu8(a, b), _mm256_and_si256(_mm256_xor_si256(a, b), _mm256_set1_epi8(1)));
+}
+
+__attribute__((target("avx2")))
+void BlurRowAvx2(const uint32_t* in, int width, uint32_t* out) {
+    int x = 1;
+    for(; x + 9 <= width; x += 8) {
+        __m256i left = _mm256_loadu_si256((const __m256i*) &in[x - 1]);
+        __m256i center = _mm256_loadu_si256((const __m256i*) &in[x]);
+        __m256i right = _mm256_loadu_si256((const __m256i*) &in[x + 1]);
+        _mm256_storeu_si256((__m256i*) &out[x], AverageAvx2(center, AverageAvx2(left, right)));
+    }
+    BlurRowScalar(in, width, 0, 1, out);
+    BlurRowScalar(in, width, x, width, out);
+}
+
+}
+
+Filter::Filter(Type type, int scale, unsigned threads) : pool_(threads) {
+    SetType(type, scale);
+}
+
+Filter::Type Filter::GetType() {
+    return type_;
+}
+
+int Filter::GetScale() {
+    return scale_;
+}
+
+void Filter::SetType(Type type, int scale) {
+    type_ = type;
+    switch(type) {
+    case kScale2x:
+    case kEdgeDirected:
+        scale_ = 2;
+        break;
+    case kScale3x:
+        scale_ = 3;
+        break;
+    default:
+        scale_ = std::max(scale, 1);
+        break;
+    }
+}
+
+void Filter::Apply(const uint32_t* in, int width, int height, uint32_t* out) {
+    ApplyRange(in, width, height, out, 0, height);
+}
+
+void Filter::ApplyRange(const uint32_t* in, int width, int height, uint32_t* out, int first, int last) {
+    int jobs = (last - first + kRowsPerJob - 1) / kRowsPerJob;
+    pool_.Dispatch(jobs, [=](size_t job) {
+        ApplyRows(in, width, height, out, first + job * kRowsPerJob, std::min<int>(first + (job + 1) * kRowsPerJob, last));
+    });
+    pool_.Wait();
+}
+
+int Filter::GetRowMargin() {
+    switch(type_) {
+    case kScale2x:
+    case kScale3x:
+    case kEdgeDirected:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+void Filter::ApplyRows(const uint32_t* in, int width, int height, uint32_t* out, int first, int last) {
+    int out_width = width * scale_;
+    std::vector<uint32_t> blurred;
+    if(type_ == kNtscBlur)
+        blurred.resize(width);
+    for(int y = first; y < last; ++y) {
+        const uint32_t* up = &in[std::max(y - 1, 0) * width];
+        const uint32_t* row = &in[y * width];
+        const uint32_t* down = &in[std::min(y + 1, height - 1) * width];
+        uint32_t* dest = &out[y * scale_ * out_width];
+        int filled = 1;
+        switch(type_) {
+        case kNearest:
+            NearestRow(row, width, scale_, dest);
+            break;
+        case kScale2x:
+            if(HasAvx2())
+                Scale2xAvx2(up, row, down, width, dest, dest + out_width);
+            else
+                Scale2xScalar(up, row, down, width, 0, width, dest, dest + out_width);
+            filled = 2;
+            break;
+        case kScale3x:
+            if(HasAvx2())
+                Scale3xAvx2(up, row, down, width, dest, dest + out_width, dest + 2 * out_width);
+            else
+                Scale3xScalar(up, row, down, width, 0, width, dest, dest + out_width, dest + 2 * out_width);
+            filled = 3;
+            break;
+        case kEdgeDirected:
+            EdgeDirectedRow(up, row, down, width, dest, dest + out_width);
+            filled = 2;
+            break;
+        case kNtscBlur:
+            if(HasAvx2())
+                BlurRowAvx2(row, width, blurred.data());
+            else
+                BlurRowScalar(row, width, 0, width, blurred.data());
+            NearestRow(blurred.data(), width, scale_, dest);
+            break;
+        }
+        // Remaining output rows of nearest-style filters are copies of the first
+        for(int i = filled; i < scale_; ++i)
+            std::memcpy(dest + i * out_width, dest, out_width * sizeof(uint32_t));
+    }
+}
+
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include "thread_pool.h"
+
+namespace ozones {
+
+// CPU-side upscaling between the PPU output and texture upload.
+// Rows are split across a thread pool; the hot kernels have AVX2 paths.
+class Filter {
+public:
+    enum Type {
+        kNearest,
+        kScale2x,
+        kScale3x,
+        kEdgeDirected,
+        kNtscBlur
+    };
+    // scale is the integer factor of kNearest and kNtscBlur, the others have a fixed one
+    Filter(Type type, int scale, unsigned threads);
+    Type GetType();
+    int GetScale();
+    // Applies a new type and scale; it's the caller's job to resize the output
+    void SetType(Type type, int scale);
+    // Filters a width x height RGBA image into a GetScale() times larger one
+    void Apply(const uint32_t* in, int width, int height, uint32_t* out);
+    // Same as Apply but only produces the output of input rows [first, last)
+    void ApplyRange(const uint32_t* in, int width, int height, uint32_t* out, int first, int last);
+    // How many rows above and below a changed input row have their output changed too
+    int GetRowMargin();
+private:
+    void ApplyRows(const uint32_t* in, int width, int height, uint32_t* out, int first, int last);
+    static const int kRowsPerJob = 8;
+    ThreadPool pool_;
+    Type type_;
+    int scale_;
+};
+
+}
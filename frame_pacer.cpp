@@ -0,0 +1,76 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "frame_pacer.h"
+#include <thread>
+
+namespace ozones {
+
+constexpr double FramePacer::kNtscFrameRate;
+constexpr double FramePacer::kPalFrameRate;
+constexpr std::chrono::microseconds FramePacer::kSpinMargin;
+constexpr std::chrono::milliseconds FramePacer::kStatsInterval;
+
+FramePacer::FramePacer(double frame_rate) : frame_rate_(frame_rate), mode_(kNormal), turbo_frame_skip_(8), slow_motion_factor_(0.25), emulated_fps_(0), deadline_(Clock::now()), stats_start_(deadline_), frame_counter_(0), stats_frames_(0) { }
+
+void FramePacer::SetMode(Mode mode) {
+    mode_ = mode;
+}
+
+FramePacer::Mode FramePacer::GetMode() {
+    return (Mode) mode_.load();
+}
+
+void FramePacer::SetTurboFrameSkip(int n) {
+    turbo_frame_skip_ = n > 0 ? n : 1;
+}
+
+void FramePacer::SetSlowMotionFactor(double factor) {
+    if(factor > 0 && factor <= 1)
+        slow_motion_factor_ = factor;
+}
+
+bool FramePacer::ShouldRender() {
+    if(GetMode() != kTurbo)
+        return true;
+    return frame_counter_ % turbo_frame_skip_ == 0;
+}
+
+void FramePacer::EndFrame() {
+    ++frame_counter_;
+    ++stats_frames_;
+    Clock::time_point now = Clock::now();
+    if(now - stats_start_ >= kStatsInterval) {
+        emulated_fps_ = stats_frames_ / std::chrono::duration<double>(now - stats_start_).count();
+        stats_start_ = now;
+        stats_frames_ = 0;
+    }
+    Mode mode = GetMode();
+    if(mode == kTurbo) {
+        deadline_ = now;
+        return;
+    }
+    std::chrono::duration<double> period(1.0 / GetTargetFps());
+    // Advance by whole periods from the previous deadline so sleep error doesn't accumulate
+    deadline_ += std::chrono::duration_cast<Clock::duration>(period);
+    if(now - deadline_ > kMaxLagFrames * period) {
+        deadline_ = now;
+        return;
+    }
+    if(deadline_ - now > kSpinMargin)
+        std::this_thread::sleep_until(deadline_ - kSpinMargin);
+    while(Clock::now() < deadline_)
+        std::this_thread::yield();
+}
+
+double FramePacer::GetTargetFps() {
+    if(GetMode() == kSlowMotion)
+        return frame_rate_ * slow_motion_factor_;
+    return frame_rate_;
+}
+
+double FramePacer::GetEmulatedFps() {
+    return emulated_fps_;
+}
+
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace ozones {
+
+// Paces the emulation thread to the console frame rate. Modes and settings
+// may be changed from another thread; EndFrame must only be called from one.
+class FramePacer {
+public:
+    enum Mode {
+        kNormal,
+        kTurbo,
+        kSlowMotion
+    };
+    static constexpr double kNtscFrameRate = 60.0988;
+    static constexpr double kPalFrameRate = 50.0070;
+    FramePacer(double frame_rate = kNtscFrameRate);
+    void SetMode(Mode mode);
+    Mode GetMode();
+    // Turbo runs uncapped and renders only every nth frame
+    void SetTurboFrameSkip(int n);
+    // Slow motion runs at frame_rate * factor, factor in (0, 1]
+    void SetSlowMotionFactor(double factor);
+    // Whether the frame about to be emulated should be drawn
+    bool ShouldRender();
+    // Called after every emulated frame, sleeps until the next one is due
+    void EndFrame();
+    double GetTargetFps();
+    // Emulated frames per second over the last measurement interval
+    double GetEmulatedFps();
+private:
+    typedef std::chrono::steady_clock Clock;
+    // Falling further behind than this drops the debt instead of fast-forwarding to catch up
+    static const int kMaxLagFrames = 4;
+    // The last stretch before a deadline is spent yielding, as sleeps overshoot
+    static constexpr std::chrono::microseconds kSpinMargin{1000};
+    static constexpr std::chrono::milliseconds kStatsInterval{500};
+    double frame_rate_;
+    std::atomic<int> mode_;
+    std::atomic<int> turbo_frame_skip_;
+    std::atomic<double> slow_motion_factor_;
+    std::atomic<double> emulated_fps_;
+    Clock::time_point deadline_;
+    Clock::time_point stats_start_;
+    uint64_t frame_counter_;
+    uint64_t stats_frames_;
+};
+
+}
@@ -4,6 +4,7 @@
 
 namespace ozones {
 struct INesHeader {
+    static const uint32_t kSignature = 0x1A53454E; // "NES\x1A"
     uint32_t signature;
     uint8_t prg_rom_size; // in 16 KiB units
     uint8_t chr_rom_size; // in 8KiB units
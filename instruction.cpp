@@ -1221,6 +1221,8 @@ Instruction::Instruction(std::shared_ptr<Ram> ram, uint16_t addr) : cycles_(2),
     }
 }
 
+Instruction::Instruction() : cycles_(2), length_(1), mnemonic_(kNop) { }
+
 int Instruction::GetCycles() {
     return cycles_;
 }
@@ -105,6 +105,8 @@ public:
         kIsc
     };
     Instruction(std::shared_ptr<Ram> ram, uint16_t addr);
+    // A NOP, as a placeholder
+    Instruction();
     int GetCycles();
     size_t GetLength();
     Operand GetOperand();
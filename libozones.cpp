@@ -0,0 +1,116 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "libozones.h"
+#include <exception>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "machine.h"
+
+using namespace ozones;
+
+struct ozones_machine {
+    std::unique_ptr<Machine> machine;
+    // Samples of the last frame, read out of the blip buffer once per frame
+    std::vector<int16_t> audio;
+    size_t audio_count;
+};
+
+namespace {
+
+thread_local std::string last_error;
+
+// No exception may cross into the caller's language
+template<typename F>
+int Guard(F f) {
+    try {
+        f();
+        return 0;
+    } catch(std::exception& e) {
+        last_error = e.what();
+        return -1;
+    }
+}
+
+}
+
+int ozones_api_version(void) {
+    return OZONES_API_VERSION;
+}
+
+const char* ozones_last_error(void) {
+    return last_error.c_str();
+}
+
+ozones_machine* ozones_create(const uint8_t* rom, size_t size) {
+    std::unique_ptr<ozones_machine> handle;
+    int result = Guard([&] {
+        std::istringstream stream(std::string((const char*) rom, size));
+        handle = std::make_unique<ozones_machine>();
+        handle->machine = std::make_unique<Machine>(stream);
+        handle->audio_count = 0;
+    });
+    return result == 0 ? handle.release() : nullptr;
+}
+
+void ozones_destroy(ozones_machine* machine) {
+    delete machine;
+}
+
+int ozones_run_frame(ozones_machine* machine, int render) {
+    return Guard([&] {
+        machine->machine->RunFrame(render ? Ppu::kRenderFull : Ppu::kRenderTimingOnly);
+        machine->audio.resize(machine->machine->SamplesAvailable());
+        machine->audio_count = machine->machine->ReadSamples(machine->audio.data(), machine->audio.size());
+    });
+}
+
+void ozones_set_input(ozones_machine* machine, unsigned port, uint8_t buttons) {
+    machine->machine->SetButtons(port & 1, buttons);
+}
+
+size_t ozones_state_size(ozones_machine* machine) {
+    return machine->machine->GetStateSize();
+}
+
+int ozones_save_state(ozones_machine* machine, uint8_t* buffer, size_t size) {
+    return Guard([&] {
+        machine->machine->SaveState(buffer, size);
+    });
+}
+
+int ozones_load_state(ozones_machine* machine, const uint8_t* buffer, size_t size) {
+    return Guard([&] {
+        machine->machine->LoadState(buffer, size);
+        machine->audio_count = 0;
+    });
+}
+
+const uint8_t* ozones_framebuffer(ozones_machine* machine) {
+    return machine->machine->GetFramebuffer();
+}
+
+const uint32_t* ozones_framebuffer_rgba(ozones_machine* machine) {
+    return machine->machine->GetRgbaFramebuffer();
+}
+
+const int16_t* ozones_audio(ozones_machine* machine, size_t* count) {
+    *count = machine->audio_count;
+    return machine->audio.data();
+}
+
+int ozones_set_sample_rate(ozones_machine* machine, double sample_rate) {
+    return Guard([&] {
+        machine->machine->SetSampleRate(sample_rate);
+    });
+}
+
+void ozones_set_audio_enabled(ozones_machine* machine, int enabled) {
+    machine->machine->SetAudioEnabled(enabled != 0);
+}
+
+const uint8_t* ozones_ram(ozones_machine* machine) {
+    return machine->machine->GetRam();
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+// C interface to the emulation core, for embedding it in other languages.
+// Functions returning int give 0 on success and -1 on failure, with the
+// reason in ozones_last_error(). Pointers into a machine stay valid until
+// the next call that runs or loads it.
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(__GNUC__)
+#define OZONES_API __attribute__((visibility("default")))
+#else
+#define OZONES_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define OZONES_API_VERSION 1
+
+#define OZONES_SCREEN_WIDTH 256
+#define OZONES_SCREEN_HEIGHT 240
+#define OZONES_RAM_SIZE 2048
+
+// Controller button masks
+#define OZONES_BUTTON_A      0x01
+#define OZONES_BUTTON_B      0x02
+#define OZONES_BUTTON_SELECT 0x04
+#define OZONES_BUTTON_START  0x08
+#define OZONES_BUTTON_UP     0x10
+#define OZONES_BUTTON_DOWN   0x20
+#define OZONES_BUTTON_LEFT   0x40
+#define OZONES_BUTTON_RIGHT  0x80
+
+typedef struct ozones_machine ozones_machine;
+
+// OZONES_API_VERSION of the library actually loaded
+OZONES_API int ozones_api_version(void);
+// Message of the last failure on the calling thread, valid until its next failure
+OZONES_API const char* ozones_last_error(void);
+
+// Powers on a machine running an iNES image; returns NULL on failure
+OZONES_API ozones_machine* ozones_create(const uint8_t* rom, size_t size);
+OZONES_API void ozones_destroy(ozones_machine* machine);
+
+// Runs until the next vblank. Without render only timing is emulated and the
+// framebuffer keeps the last frame drawn.
+OZONES_API int ozones_run_frame(ozones_machine* machine, int render);
+// port is 0 or 1, buttons a mask of OZONES_BUTTON_*
+OZONES_API void ozones_set_input(ozones_machine* machine, unsigned port, uint8_t buttons);
+
+OZONES_API size_t ozones_state_size(ozones_machine* machine);
+// buffer must hold exactly ozones_state_size() bytes
+OZONES_API int ozones_save_state(ozones_machine* machine, uint8_t* buffer, size_t size);
+OZONES_API int ozones_load_state(ozones_machine* machine, const uint8_t* buffer, size_t size);
+
+// OZONES_SCREEN_WIDTH * OZONES_SCREEN_HEIGHT palette indices, one byte per pixel
+OZONES_API const uint8_t* ozones_framebuffer(ozones_machine* machine);
+// The same frame as 0xAABBGGRR pixels
+OZONES_API const uint32_t* ozones_framebuffer_rgba(ozones_machine* machine);
+// Mono samples produced by the last frame; count receives their number
+OZONES_API const int16_t* ozones_audio(ozones_machine* machine, size_t* count);
+// Audio is produced at 96 kHz unless set otherwise
+OZONES_API int ozones_set_sample_rate(ozones_machine* machine, double sample_rate);
+OZONES_API void ozones_set_audio_enabled(ozones_machine* machine, int enabled);
+// OZONES_RAM_SIZE bytes of work RAM, read without side effects
+OZONES_API const uint8_t* ozones_ram(ozones_machine* machine);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,13 @@
+# The emulation core as a library with a C interface, no SFML involved
+TEMPLATE = lib
+TARGET = ozones
+CONFIG += c++17 thread
+CONFIG -= qt
+
+include(core.pri)
+
+SOURCES += \
+    libozones.cpp
+
+HEADERS += \
+    libozones.h
@@ -0,0 +1,336 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "machine.h"
+#include <algorithm>
+#include <fstream>
+#include <stdexcept>
+#include "mapped_file.h"
+
+namespace ozones {
+
+Machine::Machine(std::istream& rom, unsigned render_threads) : Machine(std::make_shared<Cartridge>(rom), render_threads) { }
+
+Machine::Machine(std::shared_ptr<Cartridge> cartridge, unsigned render_threads) : cartridge_(cartridge), render_threads_(render_threads) {
+    CreateDevices(true);
+    std::vector<uint8_t> power_on_state;
+    power_on_epoch_ = SaveState(power_on_state);
+    power_on_state_ = std::make_shared<const std::vector<uint8_t>>(std::move(power_on_state));
+}
+
+Machine::Machine(Machine& parent, unsigned render_threads) : cartridge_(parent.cartridge_), render_threads_(render_threads), power_on_state_(parent.power_on_state_) {
+    CreateDevices(false);
+    blip_->SetRates(Apu::kCpuClockRate, parent.GetSampleRate());
+    std::vector<uint8_t> state(state_size_);
+    StateWriter writer(state.data());
+    parent.SaveState(writer);
+    StateReader reader(state.data());
+    LoadState(reader);
+    // Loading marked every page written
+    power_on_epoch_ = state_epoch_;
+}
+
+std::unique_ptr<Machine> Machine::Fork() {
+    return std::unique_ptr<Machine>(new Machine(*this, 0));
+}
+
+void Machine::HardReset() {
+    power_on_epoch_ = RestoreState(*power_on_state_, power_on_epoch_);
+    blip_->Clear();
+}
+
+void Machine::SoftReset() {
+    cpu_->Reset();
+    ppu_->Reset();
+    apu_->Reset();
+}
+
+void Machine::RunFrame(Ppu::RenderMode mode) {
+    ppu_->SetRenderMode(mode);
+    // Nobody is draining the audio, drop the oldest samples to make room for this frame
+    size_t available = blip_->SamplesAvailable();
+    if(available > kMaxSamples / 2)
+        blip_->RemoveSamples(available - kMaxSamples / 2);
+    do {
+        int cycles = cpu_->Tick();
+        ppu_->Tick(3 * cycles);
+        apu_->Tick(cycles);
+        if(ppu_->PollNmi())
+            cpu_->SetNmiPending(true);
+        cpu_->SetIrqPending(apu_->IsIrqPending());
+    } while(!ppu_->PollFrameComplete());
+    apu_->EndFrame();
+    if(const FrameState* frame = ppu_->GetCompletedFrame())
+        GetRenderer().Submit(frame);
+}
+
+void Machine::RunFrameAhead(int run_ahead) {
+    if(run_ahead <= 0) {
+        RunFrame(Ppu::kRenderFull);
+        return;
+    }
+    RunFrame(Ppu::kRenderTimingOnly);
+    uint32_t epoch = SaveState(run_ahead_state_);
+    bool muted = blip_->IsMuted();
+    blip_->SetMuted(true);
+    for(int i = 1; i <= run_ahead; ++i)
+        RunFrame(i == run_ahead ? Ppu::kRenderFull : Ppu::kRenderTimingOnly);
+    blip_->SetMuted(muted);
+    RestoreState(run_ahead_state_, epoch);
+}
+
+const uint8_t* Machine::GetFramebuffer() {
+    return GetRenderer().GetFramebuffer();
+}
+
+const uint32_t* Machine::GetRgbaFramebuffer() {
+    return GetRenderer().GetRgbaFramebuffer();
+}
+
+const uint64_t* Machine::GetRowHashes() {
+    return GetRenderer().GetRowHashes();
+}
+
+size_t Machine::ReadSamples(int16_t* out, size_t count) {
+    return blip_->ReadSamples(out, count);
+}
+
+size_t Machine::SamplesAvailable() {
+    return blip_->SamplesAvailable();
+}
+
+double Machine::GetSampleRate() {
+    return blip_->GetSampleRate();
+}
+
+void Machine::SetSampleRate(double sample_rate) {
+    blip_->SetRates(Apu::kCpuClockRate, sample_rate);
+}
+
+void Machine::SetAudioEnabled(bool enabled) {
+    blip_->SetMuted(!enabled);
+}
+
+void Machine::SetButtons(size_t port, uint8_t buttons) {
+    controllers_->SetButtons(port, buttons);
+}
+
+uint32_t Machine::SaveState(std::vector<uint8_t>& state) {
+    state.resize(sizeof(StateHeader) + state_size_);
+    return SaveState(state.data(), state.size());
+}
+
+uint32_t Machine::SaveState(uint8_t* state, size_t size) {
+    if(size != sizeof(StateHeader) + state_size_)
+        throw std::runtime_error("Save state buffer doesn't match this machine");
+    StateHeader header;
+    header.magic = StateHeader::kMagic;
+    header.version = StateHeader::kVersion;
+    header.rom_hash = cartridge_->GetHash();
+    header.size = state_size_;
+    StateWriter writer(state);
+    writer.Write(header);
+    SaveState(writer);
+    return StartStateEpoch();
+}
+
+void Machine::LoadState(const std::vector<uint8_t>& state) {
+    LoadState(state.data(), state.size());
+}
+
+void Machine::LoadState(const uint8_t* state, size_t size) {
+    if(size != sizeof(StateHeader) + state_size_)
+        throw std::runtime_error("Save state doesn't match this machine");
+    StateHeader header;
+    StateReader reader(state);
+    reader.Read(header);
+    CheckStateHeader(header, StateHeader::kMagic, state_size_);
+    LoadState(reader);
+}
+
+uint32_t Machine::SaveStateDelta(std::vector<uint8_t>& delta, uint32_t since) {
+    StateWriter counter(nullptr);
+    SaveStateDelta(counter, since);
+    delta.resize(sizeof(StateHeader) + counter.GetSize());
+    StateHeader header;
+    header.magic = StateHeader::kDeltaMagic;
+    header.version = StateHeader::kVersion;
+    header.rom_hash = cartridge_->GetHash();
+    header.size = counter.GetSize();
+    StateWriter writer(delta.data());
+    writer.Write(header);
+    SaveStateDelta(writer, since);
+    return StartStateEpoch();
+}
+
+void Machine::LoadStateDelta(const std::vector<uint8_t>& delta) {
+    if(delta.size() < sizeof(StateHeader))
+        throw std::runtime_error("Not a save state delta");
+    StateHeader header;
+    StateReader reader(delta.data(), delta.size());
+    reader.Read(header);
+    CheckStateHeader(header, StateHeader::kDeltaMagic, delta.size() - sizeof(StateHeader));
+    // A delta that turns out truncated part way leaves the machine as it was
+    hash_state_.resize(state_size_);
+    StateWriter backup(hash_state_.data());
+    SaveState(backup);
+    try {
+        cpu_->LoadState(reader);
+        ram_->LoadStateDelta(reader);
+        ppu_->LoadState(reader);
+        vram_->LoadStateDelta(reader);
+        apu_->LoadState(reader);
+        controllers_->LoadState(reader);
+    } catch(std::runtime_error&) {
+        StateReader restore(hash_state_.data());
+        LoadState(restore);
+        throw;
+    }
+}
+
+size_t Machine::GetStateSize() {
+    return sizeof(StateHeader) + state_size_;
+}
+
+void Machine::SaveStateFile(const std::string& path) {
+    std::vector<uint8_t> state;
+    SaveState(state);
+    std::ofstream file(path, std::ios::out | std::ios::binary | std::ios::trunc);
+    if(!file.write((const char*) state.data(), state.size()))
+        throw std::runtime_error("Cannot write " + path);
+}
+
+void Machine::LoadStateFile(const std::string& path) {
+    MappedFile file(path);
+    LoadState(file.GetData(), file.GetSize());
+}
+
+uint64_t Machine::GetRomHash() {
+    return cartridge_->GetHash();
+}
+
+uint64_t Machine::GetStateHash() {
+    hash_state_.resize(state_size_);
+    StateWriter writer(hash_state_.data());
+    SaveState(writer);
+    return HashBytes(kHashBasis, hash_state_.data(), hash_state_.size());
+}
+
+void Machine::SaveState(StateWriter& writer) {
+    cpu_->SaveState(writer);
+    ram_->SaveState(writer);
+    ppu_->SaveState(writer);
+    vram_->SaveState(writer);
+    apu_->SaveState(writer);
+    controllers_->SaveState(writer);
+}
+
+void Machine::LoadState(StateReader& reader) {
+    cpu_->LoadState(reader);
+    ram_->LoadState(reader);
+    ppu_->LoadState(reader);
+    vram_->LoadState(reader);
+    apu_->LoadState(reader);
+    controllers_->LoadState(reader);
+}
+
+void Machine::SaveStateDelta(StateWriter& writer, uint32_t since) {
+    cpu_->SaveState(writer);
+    ram_->SaveStateDelta(writer, since);
+    ppu_->SaveState(writer);
+    vram_->SaveStateDelta(writer, since);
+    apu_->SaveState(writer);
+    controllers_->SaveState(writer);
+}
+
+uint32_t Machine::RestoreState(const std::vector<uint8_t>& state, uint32_t since) {
+    StateReader reader(state.data() + sizeof(StateHeader));
+    cpu_->LoadState(reader);
+    ram_->RestoreState(reader, since);
+    ppu_->LoadState(reader);
+    vram_->RestoreState(reader, since);
+    apu_->LoadState(reader);
+    controllers_->LoadState(reader);
+    // Everything written so far matches the snapshot again
+    return StartStateEpoch();
+}
+
+void Machine::CreateDevices(bool audio_enabled) {
+    ram_ = std::make_shared<Ram>(2048);
+    ram_->Map(cartridge_->GetPrgRom(), 0x8000, 0, 0x8000);
+    vram_ = std::make_shared<Vram>(cartridge_->GetChr(), cartridge_->IsChrWritable(), cartridge_->GetMirroring());
+    ppu_ = std::make_shared<Ppu>(vram_, ram_);
+    ram_->Map(ppu_, 0x2000, 0x2000, 0x2000);
+    ram_->Map(ppu_, 0x4014, 0x4014, 1);
+    blip_ = std::make_shared<BlipBuffer>(Apu::kCpuClockRate, kSampleRate, kMaxSamples, !audio_enabled);
+    apu_ = std::make_shared<Apu>(ram_, blip_);
+    ram_->Map(apu_, 0x4000, 0x4000, 0x14);
+    ram_->Map(apu_, 0x4015, 0x4015, 1);
+    controllers_ = std::make_shared<Controllers>(apu_);
+    ram_->Map(controllers_, 0x4016, 0x4016, 2);
+    cpu_ = std::make_shared<Cpu>(ram_, cartridge_->GetDecodeTable());
+    StateWriter counter(nullptr);
+    SaveState(counter);
+    state_size_ = counter.GetSize();
+    state_epoch_ = 1;
+}
+
+// Created on the first frame drawn, machines that never draw don't pay for the framebuffers
+Renderer& Machine::GetRenderer() {
+    if(!renderer_)
+        renderer_ = std::make_unique<Renderer>(render_threads_);
+    return *renderer_;
+}
+
+uint32_t Machine::StartStateEpoch() {
+    ++state_epoch_;
+    ram_->SetStateEpoch(state_epoch_);
+    vram_->SetStateEpoch(state_epoch_);
+    return state_epoch_;
+}
+
+void Machine::CheckStateHeader(const StateHeader& header, uint32_t magic, size_t size) {
+    if(header.magic != magic)
+        throw std::runtime_error("Not a save state");
+    if(header.version != StateHeader::kVersion)
+        throw std::runtime_error("Unsupported save state version");
+    if(header.rom_hash != cartridge_->GetHash() || header.size != size)
+        throw std::runtime_error("Save state doesn't match this machine");
+}
+
+std::shared_ptr<Cpu> Machine::GetCpu() {
+    return cpu_;
+}
+
+std::shared_ptr<Ppu> Machine::GetPpu() {
+    return ppu_;
+}
+
+std::shared_ptr<Apu> Machine::GetApu() {
+    return apu_;
+}
+
+std::shared_ptr<BlipBuffer> Machine::GetBlipBuffer() {
+    return blip_;
+}
+
+const uint8_t* Machine::GetRam() {
+    return ram_->GetContents();
+}
+
+std::shared_ptr<Cartridge> Machine::GetCartridge() {
+    return cartridge_;
+}
+
+Machine::Footprint Machine::GetFootprint() {
+    Footprint footprint;
+    footprint.instance = sizeof(*this) + sizeof(Cpu) + sizeof(Apu) + sizeof(Controllers);
+    footprint.instance += ram_->GetMemoryUsage() + vram_->GetMemoryUsage() + ppu_->GetMemoryUsage() + blip_->GetMemoryUsage();
+    if(renderer_)
+        footprint.instance += sizeof(Renderer);
+    footprint.instance += run_ahead_state_.capacity() + hash_state_.capacity();
+    footprint.shared = cartridge_->GetMemoryUsage() + power_on_state_->capacity();
+    return footprint;
+}
+
+}
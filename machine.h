@@ -0,0 +1,125 @@
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include <vector>
+#include "apu.h"
+#include "blip_buffer.h"
+#include "cartridge.h"
+#include "controllers.h"
+#include "cpu.h"
+#include "ppu.h"
+#include "ram.h"
+#include "renderer.h"
+#include "vram.h"
+
+namespace ozones {
+
+class Machine {
+public:
+    // Frames are drawn by render_threads workers while the next one is
+    // emulated, or synchronously at the end of RunFrame when it is 0
+    Machine(std::istream& rom, unsigned render_threads = 0);
+    // Machines made from one cartridge share its ROM and decode table
+    Machine(std::shared_ptr<Cartridge> cartridge, unsigned render_threads = 0);
+    // A copy of this machine in its current state that shares the cartridge
+    // ROM; it draws synchronously, starts with audio disabled and allocates
+    // no output buffers until it draws a frame or plays audio
+    std::unique_ptr<Machine> Fork();
+    // Back to the state the machine was constructed in, reusing every buffer
+    void HardReset();
+    // The console's reset button: CPU, PPU and APU registers reset, memory is kept
+    void SoftReset();
+    // Runs until the PPU enters vblank
+    void RunFrame(Ppu::RenderMode mode = Ppu::kRenderFull);
+    // Runs a frame, then draws the one run_ahead frames later with the same
+    // input and rolls back, hiding that many frames of the game's input lag
+    void RunFrameAhead(int run_ahead);
+    // Waits for the last kRenderFull frame to be drawn
+    const uint8_t* GetFramebuffer();
+    const uint32_t* GetRgbaFramebuffer();
+    const uint64_t* GetRowHashes();
+    // Audio produced by the frames run so far, at GetSampleRate()
+    size_t ReadSamples(int16_t* out, size_t count);
+    size_t SamplesAvailable();
+    double GetSampleRate();
+    // Takes effect from the next frame, e.g. for dynamic rate control
+    void SetSampleRate(double sample_rate);
+    // Frames run while disabled still emulate the APU but produce no samples
+    void SetAudioEnabled(bool enabled);
+    void SetButtons(size_t port, uint8_t buttons);
+    // Snapshot of all emulated state behind a StateHeader; cartridge ROM,
+    // audio and video output aren't included. Every snapshot starts a new
+    // epoch and returns it, for later deltas against it.
+    uint32_t SaveState(std::vector<uint8_t>& state);
+    // Into a caller's buffer of exactly GetStateSize() bytes
+    uint32_t SaveState(uint8_t* state, size_t size);
+    void LoadState(const std::vector<uint8_t>& state);
+    void LoadState(const uint8_t* state, size_t size);
+    // Registers plus only the memory pages written since epoch `since`
+    uint32_t SaveStateDelta(std::vector<uint8_t>& delta, uint32_t since);
+    // Applies a delta onto the state it was taken against; throws, leaving
+    // the machine unchanged, if it is truncated or was forged
+    void LoadStateDelta(const std::vector<uint8_t>& delta);
+    // Returns to a snapshot this machine took, copying only the memory pages
+    // written since the epoch SaveState returned. Returns the epoch to pass
+    // when returning to the same snapshot again.
+    uint32_t RestoreState(const std::vector<uint8_t>& state, uint32_t since);
+    // Header included
+    size_t GetStateSize();
+    // The file holds exactly the SaveState buffer and is loaded straight from a mapping
+    void SaveStateFile(const std::string& path);
+    void LoadStateFile(const std::string& path);
+    uint64_t GetRomHash();
+    // Hash of the emulated state, for checking that two runs stayed in step
+    uint64_t GetStateHash();
+    std::shared_ptr<Cpu> GetCpu();
+    std::shared_ptr<Ppu> GetPpu();
+    std::shared_ptr<Apu> GetApu();
+    std::shared_ptr<BlipBuffer> GetBlipBuffer();
+    // The 2 KiB of work RAM, read without any side effects
+    const uint8_t* GetRam();
+    std::shared_ptr<Cartridge> GetCartridge();
+    // Object and heap bytes, for packing many machines onto a host
+    struct Footprint {
+        // Owned by this machine alone: its emulated state and any output buffers in use
+        size_t instance;
+        // The cartridge and the power-on snapshot, shared with other machines
+        size_t shared;
+    };
+    Footprint GetFootprint();
+private:
+    Machine(Machine& parent, unsigned render_threads);
+    void CreateDevices(bool audio_enabled);
+    Renderer& GetRenderer();
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+    void SaveStateDelta(StateWriter& writer, uint32_t since);
+    uint32_t StartStateEpoch();
+    void CheckStateHeader(const StateHeader& header, uint32_t magic, size_t size);
+    // Synthesis runs above the host rate and is resampled by the frontend
+    static constexpr double kSampleRate = 96000.0;
+    static constexpr size_t kMaxSamples = 8192;
+    std::shared_ptr<Ram> ram_;
+    std::shared_ptr<Cartridge> cartridge_;
+    std::shared_ptr<Vram> vram_;
+    std::shared_ptr<Ppu> ppu_;
+    std::shared_ptr<Cpu> cpu_;
+    std::shared_ptr<BlipBuffer> blip_;
+    std::shared_ptr<Apu> apu_;
+    std::shared_ptr<Controllers> controllers_;
+    std::unique_ptr<Renderer> renderer_;
+    unsigned render_threads_;
+    size_t state_size_;
+    uint32_t state_epoch_;
+    // Shared with forks, for HardReset
+    std::shared_ptr<const std::vector<uint8_t>> power_on_state_;
+    uint32_t power_on_epoch_;
+    std::vector<uint8_t> run_ahead_state_;
+    // Scratch copy of the state for GetStateHash and LoadStateDelta
+    std::vector<uint8_t> hash_state_;
+};
+
+}
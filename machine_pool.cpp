@@ -0,0 +1,40 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "machine_pool.h"
+
+namespace ozones {
+
+MachinePool::MachinePool(std::istream& rom, size_t preallocate) : prototype_(rom) {
+    for(size_t i = 0; i < preallocate; ++i)
+        free_.push_back(prototype_.Fork());
+}
+
+std::unique_ptr<Machine> MachinePool::Acquire() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!free_.empty()) {
+            std::unique_ptr<Machine> machine = std::move(free_.back());
+            free_.pop_back();
+            return machine;
+        }
+    }
+    // The prototype is never run, so forking it concurrently is safe
+    return prototype_.Fork();
+}
+
+void MachinePool::Release(std::unique_ptr<Machine> machine) {
+    machine->HardReset();
+    machine->SetAudioEnabled(false);
+    machine->SetButtons(0, 0);
+    machine->SetButtons(1, 0);
+    std::lock_guard<std::mutex> lock(mutex_);
+    free_.push_back(std::move(machine));
+}
+
+size_t MachinePool::GetFreeCount() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+}
+
+}
@@ -0,0 +1,28 @@
+#pragma once
+
+#include <cstddef>
+#include <istream>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "machine.h"
+
+namespace ozones {
+
+// Machines for one ROM that are handed out and taken back instead of being
+// constructed and destroyed per job. New ones are forks of a powered-on
+// prototype, so the ROM is parsed once; returned ones are hard reset.
+class MachinePool {
+public:
+    MachinePool(std::istream& rom, size_t preallocate = 0);
+    // A machine in its power-on state with audio disabled
+    std::unique_ptr<Machine> Acquire();
+    void Release(std::unique_ptr<Machine> machine);
+    size_t GetFreeCount();
+private:
+    Machine prototype_;
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<Machine>> free_;
+};
+
+}
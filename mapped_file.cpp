@@ -0,0 +1,48 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "mapped_file.h"
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ozones {
+
+MappedFile::MappedFile(const std::string& path) : data_(nullptr), size_(0) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0)
+        throw std::runtime_error("Cannot open " + path);
+    struct stat info;
+    if(fstat(fd, &info) < 0) {
+        close(fd);
+        throw std::runtime_error("Cannot stat " + path);
+    }
+    size_ = info.st_size;
+    if(size_) {
+        void* data = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(data == MAP_FAILED) {
+            close(fd);
+            throw std::runtime_error("Cannot map " + path);
+        }
+        data_ = (const uint8_t*) data;
+    }
+    // The mapping keeps the file referenced
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if(data_)
+        munmap((void*) data_, size_);
+}
+
+const uint8_t* MappedFile::GetData() {
+    return data_;
+}
+
+size_t MappedFile::GetSize() {
+    return size_;
+}
+
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace ozones {
+
+// Read-only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    const uint8_t* GetData();
+    size_t GetSize();
+private:
+    const uint8_t* data_;
+    size_t size_;
+};
+
+}
@@ -0,0 +1,127 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "movie.h"
+#include <cstring>
+#include <stdexcept>
+
+namespace ozones {
+
+MovieWriter::MovieWriter(const std::string& path, uint64_t rom_hash, uint32_t hash_interval) : file_(path, std::ios::out | std::ios::binary | std::ios::trunc), header_(), last_hash_(0), finished_(false) {
+    if(!file_)
+        throw std::runtime_error("Cannot write " + path);
+    if(hash_interval == 0)
+        throw std::runtime_error("Movie hash interval must be positive");
+    header_.magic = MovieHeader::kMagic;
+    header_.version = MovieHeader::kVersion;
+    header_.rom_hash = rom_hash;
+    header_.hash_interval = hash_interval;
+    file_.write((const char*) &header_, sizeof(header_));
+}
+
+MovieWriter::~MovieWriter() {
+    try {
+        Finish();
+    } catch(std::runtime_error&) {
+    }
+}
+
+void MovieWriter::AddFrame(uint16_t input, Machine& machine) {
+    // Kept for every frame since any of them may turn out to be the last
+    last_hash_ = machine.GetStateHash();
+    uint32_t digest = MovieHeader::FoldHash(last_hash_);
+    file_.write((const char*) &input, sizeof(input));
+    file_.write((const char*) &digest, sizeof(digest));
+    ++header_.frame_count;
+    if(header_.frame_count % header_.hash_interval == 0)
+        file_.write((const char*) &last_hash_, sizeof(last_hash_));
+}
+
+void MovieWriter::Finish() {
+    if(finished_)
+        return;
+    finished_ = true;
+    if(header_.frame_count % header_.hash_interval)
+        file_.write((const char*) &last_hash_, sizeof(last_hash_));
+    file_.seekp(0);
+    file_.write((const char*) &header_, sizeof(header_));
+    file_.flush();
+    if(!file_)
+        throw std::runtime_error("Cannot write movie");
+}
+
+MovieReader::MovieReader(const std::string& path) : file_(path), frame_size_(0) {
+    if(file_.GetSize() < sizeof(header_))
+        throw std::runtime_error("Not a movie");
+    std::memcpy(&header_, file_.GetData(), sizeof(header_));
+    if(header_.magic != MovieHeader::kMagic)
+        throw std::runtime_error("Not a movie");
+    if(header_.version != 1 && header_.version != MovieHeader::kVersion)
+        throw std::runtime_error("Unsupported movie version");
+    if(header_.hash_interval == 0)
+        throw std::runtime_error("Corrupt movie header");
+    frame_size_ = header_.version == 1 ? 2 : 6;
+    // Bounded by the file size first, so a forged frame count can't overflow the size check
+    if(header_.frame_count > (file_.GetSize() - sizeof(header_)) / frame_size_)
+        throw std::runtime_error("Movie is truncated");
+    uint64_t blocks = (header_.frame_count + header_.hash_interval - 1) / header_.hash_interval;
+    if(file_.GetSize() < sizeof(header_) + header_.frame_count * frame_size_ + blocks * 8)
+        throw std::runtime_error("Movie is truncated");
+}
+
+uint64_t MovieReader::GetRomHash() {
+    return header_.rom_hash;
+}
+
+uint64_t MovieReader::GetFrameCount() {
+    return header_.frame_count;
+}
+
+uint16_t MovieReader::GetInput(uint64_t frame) {
+    uint16_t input;
+    std::memcpy(&input, file_.GetData() + GetBlockOffset(frame) + frame % header_.hash_interval * frame_size_, sizeof(input));
+    return input;
+}
+
+bool MovieReader::HasHash(uint64_t frame) {
+    return header_.version != 1 || HasBlockHash(frame);
+}
+
+bool MovieReader::MatchesHash(uint64_t frame, uint64_t state_hash) {
+    const uint8_t* block = file_.GetData() + GetBlockOffset(frame);
+    if(header_.version != 1) {
+        uint32_t digest;
+        std::memcpy(&digest, block + frame % header_.hash_interval * frame_size_ + 2, sizeof(digest));
+        if(digest != MovieHeader::FoldHash(state_hash))
+            return false;
+    }
+    if(!HasBlockHash(frame))
+        return true;
+    uint64_t hash;
+    std::memcpy(&hash, block + (frame % header_.hash_interval + 1) * frame_size_, sizeof(hash));
+    return hash == state_hash;
+}
+
+int64_t MovieReader::Play(Machine& machine) {
+    if(machine.GetRomHash() != header_.rom_hash)
+        throw std::runtime_error("Movie was recorded with another ROM");
+    for(uint64_t frame = 0; frame < header_.frame_count; ++frame) {
+        uint16_t input = GetInput(frame);
+        machine.SetButtons(0, input & 0xFF);
+        machine.SetButtons(1, input >> 8);
+        machine.RunFrame(Ppu::kRenderTimingOnly);
+        if(HasHash(frame) && !MatchesHash(frame, machine.GetStateHash()))
+            return frame;
+    }
+    return -1;
+}
+
+bool MovieReader::HasBlockHash(uint64_t frame) {
+    return (frame + 1) % header_.hash_interval == 0 || frame + 1 == header_.frame_count;
+}
+
+size_t MovieReader::GetBlockOffset(uint64_t frame) {
+    return sizeof(header_) + frame / header_.hash_interval * (header_.hash_interval * frame_size_ + 8);
+}
+
+}
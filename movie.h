@@ -0,0 +1,75 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+#include "machine.h"
+#include "mapped_file.h"
+
+namespace ozones {
+
+// Input movies: both controllers' buttons for every frame from power-on,
+// each with a 32-bit digest of the machine state after it, so playback finds
+// the exact frame a run diverged on, plus the full 64-bit state hash after
+// every hash_interval frames and after the last one. The file is a
+// MovieHeader followed by blocks of hash_interval frames, each a 2-byte input
+// and its 4-byte digest, with the block closed by its 8-byte hash. Version 1
+// movies have no digests; they are still read, but only checked per block.
+struct MovieHeader {
+    static const uint32_t kMagic = 0x564D5A4F; // "OZMV"
+    static const uint32_t kVersion = 2;
+    // The per-frame digest of a state hash
+    static uint32_t FoldHash(uint64_t hash) {
+        return (uint32_t) (hash ^ (hash >> 32));
+    }
+    uint32_t magic;
+    uint32_t version;
+    uint64_t rom_hash;
+    uint32_t hash_interval;
+    uint32_t reserved;
+    uint64_t frame_count;
+};
+
+class MovieWriter {
+public:
+    MovieWriter(const std::string& path, uint64_t rom_hash, uint32_t hash_interval = 60);
+    ~MovieWriter();
+    // Records a frame just run on machine with input, port 1 in the low byte
+    void AddFrame(uint16_t input, Machine& machine);
+    // Writes the final hash and frame count; the destructor finishes an unfinished movie
+    void Finish();
+private:
+    std::ofstream file_;
+    MovieHeader header_;
+    uint64_t last_hash_;
+    bool finished_;
+};
+
+// Reads a movie through a memory mapping, so nothing is loaded up front
+class MovieReader {
+public:
+    MovieReader(const std::string& path);
+    uint64_t GetRomHash();
+    uint64_t GetFrameCount();
+    uint16_t GetInput(uint64_t frame);
+    // Whether anything was recorded to check the state after frame against;
+    // every frame but in version 1 movies
+    bool HasHash(uint64_t frame);
+    // Compares the state hash after frame with the recorded digest and, at
+    // the end of a block, the recorded hash
+    bool MatchesHash(uint64_t frame, uint64_t state_hash);
+    // Runs the whole movie on a freshly powered-on machine without rendering.
+    // Returns the first frame whose state hash didn't match, or -1.
+    int64_t Play(Machine& machine);
+private:
+    bool HasBlockHash(uint64_t frame);
+    size_t GetBlockOffset(uint64_t frame);
+    MappedFile file_;
+    MovieHeader header_;
+    // Bytes per frame: the input, then the digest from version 2 on
+    size_t frame_size_;
+};
+
+}
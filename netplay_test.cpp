@@ -0,0 +1,216 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include "cartridge.h"
+#include "frame_pacer.h"
+#include "machine.h"
+#include "netplay_transport.h"
+#include "rollback_session.h"
+
+using namespace ozones;
+
+namespace {
+
+struct Options {
+    std::string rom;
+    uint64_t frames;
+    double latency;
+    double jitter;
+    double loss;
+    // Player 1's packets are all lost for outage_length seconds from outage_start
+    double outage_start;
+    double outage_length;
+    unsigned input_delay;
+    unsigned max_rollback;
+    // Longest a rollback should take, in seconds; the test fails if over 1% of them take longer
+    double budget;
+    uint32_t seed;
+    bool udp;
+};
+
+// Both players' buttons, changing every few frames so predictions keep missing
+uint8_t GetInput(const Options& options, unsigned player, uint64_t frame) {
+    if(frame < options.input_delay)
+        return 0;
+    uint64_t x = (frame / 6) * 0x9E3779B97F4A7C15ull ^ ((uint64_t) player << 32) ^ options.seed;
+    x ^= x >> 31;
+    x *= 0xBF58476D1CE4E5B9ull;
+    x ^= x >> 29;
+    return (uint8_t) x;
+}
+
+void PrintStats(unsigned player, RollbackSession::Stats stats) {
+    std::cout << "player " << player + 1 << ": " << stats.frames << " frames, " << stats.predicted_frames << " predicted, "
+              << stats.rollbacks << " rollbacks of " << stats.resimulated_frames << " frames (longest "
+              << stats.max_rollback_frames << " frames, " << stats.max_rollback_seconds * 1000.0 << " ms, mean "
+              << (stats.rollbacks ? stats.total_rollback_seconds * 1000.0 / stats.rollbacks : 0.0) << " ms), "
+              << stats.rollbacks_over_budget << " over budget, " << stats.stalls << " stalls" << std::endl;
+}
+
+// Two peers in one process, stepped in host frames on a simulated clock so
+// injected latency and loss give the same run every time over loopback
+int RunTest(const Options& options) {
+    std::ifstream rom(options.rom, std::ios::in | std::ios::binary);
+    if(!rom)
+        throw std::runtime_error("Cannot open " + options.rom);
+    auto cartridge = std::make_shared<Cartridge>(rom);
+    std::array<std::unique_ptr<Machine>, 2> machines;
+    for(auto& machine : machines) {
+        machine = std::make_unique<Machine>(cartridge);
+        machine->SetAudioEnabled(false);
+    }
+    double now = 0.0;
+    auto clock = [&now]() { return now; };
+    std::array<std::unique_ptr<NetplayTransport>, 2> links;
+    if(options.udp) {
+        auto a = std::make_unique<UdpTransport>(0);
+        auto b = std::make_unique<UdpTransport>(0);
+        a->Connect("127.0.0.1", b->GetLocalPort());
+        b->Connect("127.0.0.1", a->GetLocalPort());
+        links[0] = std::move(a);
+        links[1] = std::move(b);
+    } else {
+        auto pair = LoopbackTransport::CreatePair();
+        links[0] = std::move(pair.first);
+        links[1] = std::move(pair.second);
+    }
+    std::array<std::unique_ptr<ImpairedTransport>, 2> transports;
+    std::array<std::unique_ptr<RollbackSession>, 2> sessions;
+    for(unsigned player = 0; player < 2; ++player) {
+        transports[player] = std::make_unique<ImpairedTransport>(std::move(links[player]), options.latency,
+                                                                 options.jitter, options.loss, options.seed + player, clock);
+        if(player == 0)
+            transports[player]->SetOutage(options.outage_start, options.outage_length);
+        sessions[player] = std::make_unique<RollbackSession>(*machines[player], *transports[player], player,
+                                                             options.input_delay, options.max_rollback);
+        sessions[player]->SetRollbackBudget(options.budget);
+    }
+    // Run both to the last frame, then let them exchange inputs until each has confirmed all of them
+    const uint64_t kTimeoutFrames = 600;
+    uint64_t host_frame = 0;
+    for(;;) {
+        bool done = true;
+        for(unsigned player = 0; player < 2; ++player) {
+            RollbackSession& session = *sessions[player];
+            if(session.GetFrame() < options.frames) {
+                uint64_t frame = session.GetFrame() + options.input_delay;
+                session.AdvanceFrame(GetInput(options, player, frame), Ppu::kRenderTimingOnly);
+            } else {
+                session.Synchronize();
+            }
+            done &= session.GetConfirmedFrame() >= options.frames;
+        }
+        if(done)
+            break;
+        if(++host_frame > options.frames * 2 + kTimeoutFrames) {
+            std::cerr << "The peers never caught up with each other" << std::endl;
+            return EXIT_FAILURE;
+        }
+        now = host_frame / FramePacer::kNtscFrameRate;
+    }
+    // The same inputs without netplay
+    Machine reference(cartridge);
+    reference.SetAudioEnabled(false);
+    for(uint64_t frame = 0; frame < options.frames; ++frame) {
+        reference.SetButtons(0, GetInput(options, 0, frame));
+        reference.SetButtons(1, GetInput(options, 1, frame));
+        reference.RunFrame(Ppu::kRenderTimingOnly);
+    }
+    std::cout << options.frames << " frames in " << host_frame << " host frames" << std::endl;
+    bool passed = true;
+    for(unsigned player = 0; player < 2; ++player) {
+        RollbackSession::Stats stats = sessions[player]->GetStats();
+        PrintStats(player, stats);
+        if(machines[player]->GetStateHash() != reference.GetStateHash()) {
+            std::cout << "player " << player + 1 << " desynchronized" << std::endl;
+            passed = false;
+        }
+        // A single slow rollback is more likely the host scheduler than the emulator
+        if(stats.rollbacks_over_budget * 100 > stats.rollbacks) {
+            std::cout << "player " << player + 1 << " went over the " << options.budget * 1000.0 << " ms rollback budget" << std::endl;
+            passed = false;
+        }
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    // ozones-netplay-test [--frames N] [--latency ms] [--jitter ms] [--loss fraction] [--outage start_ms length_ms]
+    //                     [--delay frames] [--max-rollback frames] [--budget ms] [--seed N] [--udp] rom
+    // Without --outage, a second run takes one direction down for longer than
+    // the peers can run ahead, at the largest rollback window and input delay
+    Options options = {};
+    options.frames = 3600;
+    options.latency = 0.05;
+    options.jitter = 0.01;
+    options.loss = 0.05;
+    options.input_delay = 1;
+    options.max_rollback = 8;
+    options.budget = 0.004;
+    options.seed = 1;
+    bool outage = false;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--frames" && i + 1 < argc) {
+            options.frames = std::strtoull(argv[++i], nullptr, 10);
+        } else if(arg == "--latency" && i + 1 < argc) {
+            options.latency = std::atof(argv[++i]) / 1000.0;
+        } else if(arg == "--jitter" && i + 1 < argc) {
+            options.jitter = std::atof(argv[++i]) / 1000.0;
+        } else if(arg == "--loss" && i + 1 < argc) {
+            options.loss = std::atof(argv[++i]);
+        } else if(arg == "--outage" && i + 2 < argc) {
+            options.outage_start = std::atof(argv[++i]) / 1000.0;
+            options.outage_length = std::atof(argv[++i]) / 1000.0;
+            outage = true;
+        } else if(arg == "--delay" && i + 1 < argc) {
+            options.input_delay = (unsigned) std::atoi(argv[++i]);
+        } else if(arg == "--max-rollback" && i + 1 < argc) {
+            options.max_rollback = (unsigned) std::atoi(argv[++i]);
+        } else if(arg == "--budget" && i + 1 < argc) {
+            options.budget = std::atof(argv[++i]) / 1000.0;
+        } else if(arg == "--seed" && i + 1 < argc) {
+            options.seed = (uint32_t) std::atoi(argv[++i]);
+        } else if(arg == "--udp") {
+            options.udp = true;
+        } else {
+            options.rom = arg;
+        }
+    }
+    if(options.rom.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--frames N] [--latency ms] [--jitter ms] [--loss fraction]"
+                  << " [--outage start_ms length_ms] [--delay frames] [--max-rollback frames] [--budget ms] [--seed N]"
+                  << " [--udp] rom" << std::endl;
+        return EXIT_FAILURE;
+    }
+    try {
+        int result = RunTest(options);
+        if(outage)
+            return result;
+        Options burst = options;
+        burst.input_delay = 8;
+        burst.max_rollback = 32;
+        burst.outage_start = options.frames / FramePacer::kNtscFrameRate / 4;
+        burst.outage_length = 3.0;
+        // Catching up after the outage rolls back whole windows; this run checks recovery, not speed
+        burst.budget = std::numeric_limits<double>::infinity();
+        std::cout << "One-way outage of " << burst.outage_length << " s:" << std::endl;
+        return RunTest(burst) == EXIT_SUCCESS ? result : EXIT_FAILURE;
+    } catch(std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
@@ -0,0 +1,143 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "netplay_transport.h"
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <stdexcept>
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+namespace ozones {
+
+std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>> LoopbackTransport::CreatePair() {
+    auto a = std::make_shared<Channel>();
+    auto b = std::make_shared<Channel>();
+    return std::make_pair(std::unique_ptr<LoopbackTransport>(new LoopbackTransport(a, b)),
+                          std::unique_ptr<LoopbackTransport>(new LoopbackTransport(b, a)));
+}
+
+LoopbackTransport::LoopbackTransport(std::shared_ptr<Channel> inbox, std::shared_ptr<Channel> outbox) :
+        inbox_(inbox), outbox_(outbox) { }
+
+void LoopbackTransport::Send(const uint8_t* data, size_t size) {
+    std::lock_guard<std::mutex> lock(outbox_->mutex);
+    outbox_->packets.emplace_back(data, data + size);
+}
+
+bool LoopbackTransport::Receive(std::vector<uint8_t>& packet) {
+    std::lock_guard<std::mutex> lock(inbox_->mutex);
+    if(inbox_->packets.empty())
+        return false;
+    packet = std::move(inbox_->packets.front());
+    inbox_->packets.pop_front();
+    return true;
+}
+
+UdpTransport::UdpTransport(uint16_t local_port) {
+    socket_ = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(socket_ < 0)
+        throw std::runtime_error(std::string("socket: ") + std::strerror(errno));
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_ANY);
+    address.sin_port = htons(local_port);
+    if(bind(socket_, (sockaddr*) &address, sizeof(address)) != 0) {
+        close(socket_);
+        throw std::runtime_error("Cannot bind UDP port " + std::to_string(local_port) + ": " + std::strerror(errno));
+    }
+}
+
+UdpTransport::~UdpTransport() {
+    close(socket_);
+}
+
+void UdpTransport::Connect(const std::string& host, uint16_t port) {
+    addrinfo hints = {};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_DGRAM;
+    addrinfo* result;
+    if(getaddrinfo(host.c_str(), nullptr, &hints, &result) != 0)
+        throw std::runtime_error("Cannot resolve " + host);
+    sockaddr_in address = *(sockaddr_in*) result->ai_addr;
+    freeaddrinfo(result);
+    address.sin_port = htons(port);
+    if(connect(socket_, (sockaddr*) &address, sizeof(address)) != 0)
+        throw std::runtime_error("Cannot connect to " + host + ": " + std::strerror(errno));
+}
+
+uint16_t UdpTransport::GetLocalPort() {
+    sockaddr_in address = {};
+    socklen_t length = sizeof(address);
+    getsockname(socket_, (sockaddr*) &address, &length);
+    return ntohs(address.sin_port);
+}
+
+void UdpTransport::Send(const uint8_t* data, size_t size) {
+    // A full socket buffer or an unreachable peer is just loss
+    send(socket_, data, size, MSG_NOSIGNAL);
+}
+
+bool UdpTransport::Receive(std::vector<uint8_t>& packet) {
+    packet.resize(kMaxPacketSize);
+    for(;;) {
+        ssize_t received = recv(socket_, packet.data(), packet.size(), 0);
+        if(received >= 0) {
+            packet.resize((size_t) received);
+            return true;
+        }
+        // ICMP errors from a peer that isn't up yet are reported here; skip past them
+        if(errno != ECONNREFUSED && errno != EINTR)
+            return false;
+    }
+}
+
+ImpairedTransport::ImpairedTransport(std::unique_ptr<NetplayTransport> inner, double latency, double jitter,
+                                     double loss, uint32_t seed, Clock clock) : inner_(std::move(inner)),
+        latency_(latency), jitter_(jitter), loss_(loss), outage_start_(0.0), outage_end_(0.0), random_(seed), clock_(clock) {
+    if(!clock_) {
+        auto start = std::chrono::steady_clock::now();
+        clock_ = [start]() {
+            return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        };
+    }
+}
+
+void ImpairedTransport::SetOutage(double start, double length) {
+    outage_start_ = start;
+    outage_end_ = start + length;
+}
+
+void ImpairedTransport::Send(const uint8_t* data, size_t size) {
+    std::uniform_real_distribution<double> uniform(0.0, 1.0);
+    double now = clock_();
+    bool lost = uniform(random_) < loss_ || (now >= outage_start_ && now < outage_end_);
+    double delay = latency_ + jitter_ * uniform(random_);
+    if(!lost)
+        delayed_.push_back({ now + delay, std::vector<uint8_t>(data, data + size) });
+    SendDue();
+}
+
+bool ImpairedTransport::Receive(std::vector<uint8_t>& packet) {
+    SendDue();
+    return inner_->Receive(packet);
+}
+
+void ImpairedTransport::SendDue() {
+    double now = clock_();
+    // Jitter reorders packets, as a real network would
+    size_t kept = 0;
+    for(size_t i = 0; i < delayed_.size(); ++i) {
+        if(delayed_[i].due <= now)
+            inner_->Send(delayed_[i].packet.data(), delayed_[i].packet.size());
+        else if(kept++ != i)
+            delayed_[kept - 1] = std::move(delayed_[i]);
+    }
+    delayed_.resize(kept);
+}
+
+}
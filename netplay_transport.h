@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace ozones {
+
+// Unreliable datagrams between two netplay peers: packets may be lost,
+// duplicated or reordered, and neither call ever blocks
+class NetplayTransport {
+public:
+    virtual ~NetplayTransport() = default;
+    virtual void Send(const uint8_t* data, size_t size) = 0;
+    // Returns false when no packet is waiting
+    virtual bool Receive(std::vector<uint8_t>& packet) = 0;
+};
+
+// Both ends in one process, e.g. for two sessions driven by one test
+class LoopbackTransport : public NetplayTransport {
+public:
+    static std::pair<std::unique_ptr<LoopbackTransport>, std::unique_ptr<LoopbackTransport>> CreatePair();
+    void Send(const uint8_t* data, size_t size) override;
+    bool Receive(std::vector<uint8_t>& packet) override;
+private:
+    struct Channel {
+        std::mutex mutex;
+        std::deque<std::vector<uint8_t>> packets;
+    };
+    LoopbackTransport(std::shared_ptr<Channel> inbox, std::shared_ptr<Channel> outbox);
+    std::shared_ptr<Channel> inbox_;
+    std::shared_ptr<Channel> outbox_;
+};
+
+class UdpTransport : public NetplayTransport {
+public:
+    // Bound to local_port on all interfaces; 0 picks a free one
+    UdpTransport(uint16_t local_port);
+    ~UdpTransport();
+    UdpTransport(const UdpTransport&) = delete;
+    UdpTransport& operator=(const UdpTransport&) = delete;
+    // Only packets from the peer are received
+    void Connect(const std::string& host, uint16_t port);
+    uint16_t GetLocalPort();
+    void Send(const uint8_t* data, size_t size) override;
+    bool Receive(std::vector<uint8_t>& packet) override;
+private:
+    static const size_t kMaxPacketSize = 1500;
+    int socket_;
+};
+
+// Delays, jitters and drops the packets sent through another transport, for
+// testing. Delayed packets are handed on whenever either call is made, so the
+// owner has to keep calling it, as a session does every frame.
+class ImpairedTransport : public NetplayTransport {
+public:
+    // Seconds on any monotonic timeline; a simulated one keeps tests deterministic
+    typedef std::function<double()> Clock;
+    // Latency and jitter in seconds, loss as a probability
+    ImpairedTransport(std::unique_ptr<NetplayTransport> inner, double latency, double jitter, double loss,
+                      uint32_t seed = 1, Clock clock = nullptr);
+    // Drops everything sent from start for length seconds, like a link going down
+    void SetOutage(double start, double length);
+    void Send(const uint8_t* data, size_t size) override;
+    bool Receive(std::vector<uint8_t>& packet) override;
+private:
+    struct Delayed {
+        double due;
+        std::vector<uint8_t> packet;
+    };
+    void SendDue();
+    std::unique_ptr<NetplayTransport> inner_;
+    double latency_, jitter_, loss_;
+    double outage_start_, outage_end_;
+    std::mt19937 random_;
+    Clock clock_;
+    std::vector<Delayed> delayed_;
+};
+
+}
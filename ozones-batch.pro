@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = ozones-batch
+CONFIG += console c++17 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+include(core.pri)
+
+SOURCES += \
+    batch.cpp
@@ -0,0 +1,14 @@
+TEMPLATE = app
+TARGET = ozones-check
+CONFIG += console c++17 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+include(core.pri)
+
+SOURCES += \
+    check.cpp \
+    filter.cpp
+
+HEADERS += \
+    filter.h
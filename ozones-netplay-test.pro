@@ -0,0 +1,10 @@
+TEMPLATE = app
+TARGET = ozones-netplay-test
+CONFIG += console c++17 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+include(core.pri)
+
+SOURCES += \
+    netplay_test.cpp
@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = ozones-resampler-bench
+CONFIG += console c++17
+CONFIG -= app_bundle
+CONFIG -= qt
+
+SOURCES += \
+    resampler.cpp \
+    resampler_bench.cpp
+
+HEADERS += \
+    resampler.h \
+    simd.h
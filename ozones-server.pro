@@ -0,0 +1,13 @@
+TEMPLATE = app
+TARGET = ozones-server
+CONFIG += console c++17 thread
+CONFIG -= app_bundle
+CONFIG -= qt
+
+include(core.pri)
+
+SOURCES += \
+    server.cpp
+
+HEADERS += \
+    step_protocol.h
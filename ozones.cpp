@@ -1,41 +1,379 @@
 // This is an open source non-commercial project. Dear PVS-Studio, please check it.
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <memory>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 #include <SFML/Graphics.hpp>
-#include "cpu.h"
-#include "ines.h"
-#include "ram.h"
-#include "rom.h"
+#include "audio_output.h"
+#include "filter.h"
+#include "frame_pacer.h"
+#include "machine.h"
+#include "movie.h"
+#include "netplay_transport.h"
+#include "resampler.h"
+#include "rewind_buffer.h"
+#include "rollback_session.h"
+#include "triple_buffer.h"
 
 using namespace ozones;
 
-int main()
+namespace {
+
+const int kMaxRunAhead = 4;
+// About ten minutes of history for typical games
+const size_t kRewindBytes = 64 << 20;
+
+struct VideoFrame {
+    std::array<uint32_t, Ppu::kScreenWidth * Ppu::kScreenHeight> pixels;
+    std::array<uint64_t, Ppu::kScreenHeight> row_hashes;
+};
+
+// Set by the render thread, acted on by the emulation thread between frames
+struct Controls {
+    // Port 1 in the low byte, port 2 in the high one
+    std::atomic<uint16_t> input;
+    std::atomic<int> run_ahead;
+    std::atomic<bool> save_state;
+    std::atomic<bool> load_state;
+    std::atomic<bool> rewind;
+    std::atomic<bool> running;
+};
+
+// Controller state read on the render thread, port 1 in the low byte and port 2 in the high one
+uint16_t ReadInput() {
+    static const std::pair<sf::Keyboard::Key, uint8_t> kKeys[] = {
+        { sf::Keyboard::X, Controllers::kA },
+        { sf::Keyboard::Z, Controllers::kB },
+        { sf::Keyboard::RShift, Controllers::kSelect },
+        { sf::Keyboard::Enter, Controllers::kStart },
+        { sf::Keyboard::Up, Controllers::kUp },
+        { sf::Keyboard::Down, Controllers::kDown },
+        { sf::Keyboard::Left, Controllers::kLeft },
+        { sf::Keyboard::Right, Controllers::kRight }
+    };
+    uint16_t input = 0;
+    for(auto& key : kKeys) {
+        if(sf::Keyboard::isKeyPressed(key.first))
+            input |= key.second;
+    }
+    sf::Joystick::update();
+    for(unsigned port = 0; port < 2; ++port) {
+        if(!sf::Joystick::isConnected(port))
+            continue;
+        uint8_t buttons = 0;
+        if(sf::Joystick::isButtonPressed(port, 0))
+            buttons |= Controllers::kA;
+        if(sf::Joystick::isButtonPressed(port, 1))
+            buttons |= Controllers::kB;
+        if(sf::Joystick::isButtonPressed(port, 6))
+            buttons |= Controllers::kSelect;
+        if(sf::Joystick::isButtonPressed(port, 7))
+            buttons |= Controllers::kStart;
+        float x = sf::Joystick::getAxisPosition(port, sf::Joystick::X) + sf::Joystick::getAxisPosition(port, sf::Joystick::PovX);
+        float y = sf::Joystick::getAxisPosition(port, sf::Joystick::Y) - sf::Joystick::getAxisPosition(port, sf::Joystick::PovY);
+        if(x < -50.0f)
+            buttons |= Controllers::kLeft;
+        if(x > 50.0f)
+            buttons |= Controllers::kRight;
+        if(y < -50.0f)
+            buttons |= Controllers::kUp;
+        if(y > 50.0f)
+            buttons |= Controllers::kDown;
+        input |= (uint16_t) buttons << (8 * port);
+    }
+    return input;
+}
+
+// A movie being recorded must be one unbroken run from power-on, and a netplay
+// peer must see the same run, so loading states and rewinding are refused while
+// either is set. Run-ahead stays available while recording, since it returns to
+// the real state before the frame is recorded; netplay frames go through the
+// session instead. Netplay takes the local player's buttons from port 1.
+void EmulationLoop(Machine& machine, FramePacer& pacer, TripleBuffer<VideoFrame>& video, AudioOutput& audio, Controls& controls, const std::string& state_path, MovieWriter* movie, RollbackSession* netplay) {
+    std::vector<int16_t> samples;
+    std::vector<int16_t> resampled;
+    Resampler resampler(machine.GetSampleRate(), audio.getSampleRate());
+    RewindBuffer rewind(kRewindBytes);
+    std::vector<uint8_t> state;
+    bool locked = movie || netplay;
+    while(controls.running.load(std::memory_order_relaxed)) {
+        try {
+            if(controls.save_state.exchange(false))
+                machine.SaveStateFile(state_path);
+            if(controls.load_state.exchange(false) && !locked)
+                machine.LoadStateFile(state_path);
+        } catch(std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+        }
+        // Skipped frames still run the PPU in timing-only mode so emulation stays exact
+        uint16_t buttons = controls.input.load(std::memory_order_relaxed);
+        machine.SetButtons(0, buttons & 0xFF);
+        machine.SetButtons(1, buttons >> 8);
+        bool render = pacer.ShouldRender();
+        if(netplay) {
+            // A frame spent waiting for the peer has nothing new to show
+            render &= netplay->AdvanceFrame(buttons & 0xFF, render ? Ppu::kRenderFull : Ppu::kRenderTimingOnly);
+        } else if(controls.rewind.load(std::memory_order_relaxed) && !movie) {
+            // Each step back loads the previous state and replays one silent frame from it to show
+            if(rewind.Pop(state))
+                machine.LoadState(state);
+            machine.SetAudioEnabled(false);
+            machine.RunFrame(render ? Ppu::kRenderFull : Ppu::kRenderTimingOnly);
+            machine.SetAudioEnabled(true);
+        } else {
+            if(render)
+                machine.RunFrameAhead(controls.run_ahead.load(std::memory_order_relaxed));
+            else
+                machine.RunFrame(Ppu::kRenderTimingOnly);
+            machine.SaveState(state);
+            rewind.Push(state);
+            if(movie)
+                movie->AddFrame(buttons, machine);
+        }
+        if(render) {
+            const uint32_t* pixels = machine.GetRgbaFramebuffer();
+            VideoFrame& frame = video.GetBackBuffer();
+            std::copy_n(pixels, frame.pixels.size(), frame.pixels.begin());
+            std::copy_n(machine.GetRowHashes(), frame.row_hashes.size(), frame.row_hashes.begin());
+            video.Publish();
+        }
+        // Fast-forward audio mostly overflows the ring anyway, so it gets the cheap filter
+        resampler.SetQuality(pacer.GetMode() == FramePacer::kTurbo ? Resampler::kLinear : Resampler::kNormal);
+        resampler.SetRateAdjustment(audio.GetRateAdjustment());
+        samples.resize(machine.SamplesAvailable());
+        samples.resize(machine.ReadSamples(samples.data(), samples.size()));
+        resampled.clear();
+        resampler.Process(samples.data(), samples.size(), resampled);
+        audio.Push(resampled.data(), resampled.size());
+        pacer.EndFrame();
+    }
+}
+
+std::string FormatTitle(FramePacer& pacer, int run_ahead) {
+    std::stringstream ss;
+    ss.precision(1);
+    ss << std::fixed << "OzoNES - " << pacer.GetEmulatedFps() << " fps";
+    switch(pacer.GetMode()) {
+    case FramePacer::kNormal:
+        ss << " / " << pacer.GetTargetFps();
+        break;
+    case FramePacer::kTurbo:
+        ss << " (turbo)";
+        break;
+    case FramePacer::kSlowMotion:
+        ss << " / " << pacer.GetTargetFps() << " (slow motion)";
+        break;
+    }
+    if(run_ahead)
+        ss << " - run-ahead " << run_ahead;
+    return ss.str();
+}
+
+// Plays a movie back headless and as fast as possible
+int PlayMovie(Machine& machine, const std::string& path) {
+    MovieReader movie(path);
+    auto start = std::chrono::steady_clock::now();
+    int64_t diverged = movie.Play(machine);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    if(diverged >= 0) {
+        std::cerr << "Diverged from the recording at frame " << diverged << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::cout << movie.GetFrameCount() << " frames matched, " << movie.GetFrameCount() / elapsed.count() << " fps" << std::endl;
+    return EXIT_SUCCESS;
+}
+
+// Filters and uploads only the row spans whose hash differs from the frame on screen
+void UpdateScreen(const VideoFrame& frame, std::array<uint64_t, Ppu::kScreenHeight>& shown, bool full, Filter& filter, std::vector<uint32_t>& filtered, sf::Texture& texture) {
+    int scale = filter.GetScale();
+    int margin = filter.GetRowMargin();
+    int out_width = Ppu::kScreenWidth * scale;
+    int y = 0;
+    while(y < Ppu::kScreenHeight) {
+        if(!full && frame.row_hashes[y] == shown[y]) {
+            ++y;
+            continue;
+        }
+        int first = y;
+        while(y < Ppu::kScreenHeight && (full || frame.row_hashes[y] != shown[y]))
+            ++y;
+        // Neighbourhood filters change the output of adjacent rows as well
+        first = std::max(first - margin, 0);
+        int last = std::min(y + margin, Ppu::kScreenHeight);
+        filter.ApplyRange(frame.pixels.data(), Ppu::kScreenWidth, Ppu::kScreenHeight, filtered.data(), first, last);
+        texture.update((const sf::Uint8*) &filtered[first * scale * out_width], out_width, (last - first) * scale, 0, first * scale);
+    }
+    shown = frame.row_hashes;
+}
+
+void ResizeOutput(Filter& filter, sf::Texture& texture, sf::Sprite& screen, std::vector<uint32_t>& filtered) {
+    int scale = filter.GetScale();
+    filtered.resize(Ppu::kScreenWidth * scale * Ppu::kScreenHeight * scale);
+    texture.create(Ppu::kScreenWidth * scale, Ppu::kScreenHeight * scale);
+    screen.setTexture(texture, true);
+    screen.setScale(4.0f / scale, 4.0f / scale);
+}
+
+}
+
+int main(int argc, char** argv)
 {
-    auto ram = std::make_shared<Ram>(2048);
+    // ozones [--record movie | --play movie | --netplay player port host:port] rom [audio latency in ms]
+    std::vector<std::string> args;
+    std::string record_path, play_path;
+    int netplay_player = 0;
+    uint16_t netplay_port = 0;
+    std::string netplay_peer;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--record" && i + 1 < argc)
+            record_path = argv[++i];
+        else if(arg == "--play" && i + 1 < argc)
+            play_path = argv[++i];
+        else if(arg == "--netplay" && i + 3 < argc) {
+            netplay_player = std::atoi(argv[++i]);
+            netplay_port = (uint16_t) std::atoi(argv[++i]);
+            netplay_peer = argv[++i];
+        }
+        else
+            args.push_back(arg);
+    }
+    bool netplay_valid = netplay_peer.empty() || ((netplay_player == 1 || netplay_player == 2) && netplay_peer.find(':') != std::string::npos);
+    if(args.empty() || !netplay_valid || (!netplay_peer.empty() && !record_path.empty())) {
+        std::cerr << "Usage: " << argv[0] << " [--record movie | --play movie | --netplay player port host:port] rom [audio latency in ms]" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::string path = args[0];
     std::ifstream rom;
-    rom.open("/home/vodozhaba/nestest.nes", std::ios::in | std::ios::binary);
-    INesHeader header;
-    rom.read((char*) &header, sizeof(header));
-    auto prg_rom = std::make_shared<Rom>(rom, 16384 * header.prg_rom_size);
-    ram->Map(prg_rom, 0xC000, 0, 32768);
-    Cpu cpu(ram);
-    while(true) {
-        cpu.Tick();
+    rom.open(path, std::ios::in | std::ios::binary);
+    if(!rom) {
+        std::cerr << "Cannot open " << path << std::endl;
+        return EXIT_FAILURE;
     }
+    if(!play_path.empty()) {
+        try {
+            Machine machine(rom);
+            return PlayMovie(machine, play_path);
+        } catch(std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    Machine machine(rom, std::thread::hardware_concurrency());
+    std::unique_ptr<MovieWriter> movie;
+    if(!record_path.empty())
+        movie = std::make_unique<MovieWriter>(record_path, machine.GetRomHash());
+    // Player 1 or 2, listening on port and sending to the peer's host:port
+    std::unique_ptr<UdpTransport> transport;
+    std::unique_ptr<RollbackSession> netplay;
+    if(!netplay_peer.empty()) {
+        try {
+            size_t colon = netplay_peer.rfind(':');
+            transport = std::make_unique<UdpTransport>(netplay_port);
+            transport->Connect(netplay_peer.substr(0, colon), (uint16_t) std::atoi(netplay_peer.c_str() + colon + 1));
+            netplay = std::make_unique<RollbackSession>(machine, *transport, netplay_player - 1);
+        } catch(std::runtime_error& e) {
+            std::cerr << e.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    int latency = args.size() > 1 ? std::max(std::atoi(args[1].c_str()), 20) : 40;
+    AudioOutput audio(48000, latency);
+    // Emulation runs on its own thread and only ever hands frames over
+    // through the triple buffer, so presentation and window events can't stall it
+    TripleBuffer<VideoFrame> video;
+    FramePacer pacer;
+    // F6/F7: fewer/more frames of run-ahead, F8/F9: save/load state, Backspace: rewind while held
+    Controls controls;
+    controls.input = 0;
+    controls.run_ahead = 0;
+    controls.save_state = false;
+    controls.load_state = false;
+    controls.rewind = false;
+    controls.running = true;
+    std::string state_path = path + ".state";
+    std::thread emulation(EmulationLoop, std::ref(machine), std::ref(pacer), std::ref(video), std::ref(audio), std::ref(controls), std::cref(state_path), movie.get(), netplay.get());
+    audio.play();
     sf::RenderWindow app(sf::VideoMode(1024, 960), "OzoNES");
-    while (app.isOpen() || app.isOpen())
+    app.setVerticalSyncEnabled(true);
+    // Frames are upscaled on the CPU before upload; F1-F5 pick the filter
+    Filter filter(Filter::kNearest, 1, std::thread::hardware_concurrency());
+    sf::Texture texture;
+    sf::Sprite screen;
+    std::vector<uint32_t> filtered;
+    ResizeOutput(filter, texture, screen, filtered);
+    sf::Clock title_clock;
+    // A new texture starts out with nothing on it
+    bool refilter = true;
+    std::array<uint64_t, Ppu::kScreenHeight> shown_hashes = {};
+    while (app.isOpen())
     {
         sf::Event event;
         while (app.pollEvent(event))
         {
             if (event.type == sf::Event::Closed)
                 app.close();
+            // Tab: turbo while held, tilde: toggle slow motion
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Tab)
+                pacer.SetMode(FramePacer::kTurbo);
+            if (event.type == sf::Event::KeyReleased && event.key.code == sf::Keyboard::Tab)
+                pacer.SetMode(FramePacer::kNormal);
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::Tilde)
+                pacer.SetMode(pacer.GetMode() == FramePacer::kSlowMotion ? FramePacer::kNormal : FramePacer::kSlowMotion);
+            if (event.type == sf::Event::KeyPressed && event.key.code >= sf::Keyboard::F1 && event.key.code <= sf::Keyboard::F5) {
+                static const Filter::Type kFilters[] = { Filter::kNearest, Filter::kScale2x, Filter::kScale3x, Filter::kEdgeDirected, Filter::kNtscBlur };
+                filter.SetType(kFilters[event.key.code - sf::Keyboard::F1], 4);
+                ResizeOutput(filter, texture, screen, filtered);
+                refilter = true;
+            }
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F6)
+                controls.run_ahead = std::max(controls.run_ahead - 1, 0);
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F7)
+                controls.run_ahead = std::min(controls.run_ahead + 1, kMaxRunAhead);
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F8)
+                controls.save_state = true;
+            if (event.type == sf::Event::KeyPressed && event.key.code == sf::Keyboard::F9)
+                controls.load_state = true;
+        }
+        // Sampled here, as late as possible before the emulation thread's next frame
+        controls.input = app.hasFocus() ? ReadInput() : 0;
+        controls.rewind = app.hasFocus() && sf::Keyboard::isKeyPressed(sf::Keyboard::Backspace);
+        if(title_clock.getElapsedTime().asSeconds() >= 0.5f) {
+            app.setTitle(FormatTitle(pacer, controls.run_ahead));
+            title_clock.restart();
+        }
+        // Re-filter the frame on screen after a filter change even if no new one arrived
+        if(video.Acquire() || refilter) {
+            UpdateScreen(video.GetFrontBuffer(), shown_hashes, refilter, filter, filtered, texture);
+            refilter = false;
         }
         app.clear();
+        app.draw(screen);
         app.display();
     }
+    controls.running = false;
+    emulation.join();
+    audio.stop();
+    if(movie)
+        movie->Finish();
+    if(netplay) {
+        RollbackSession::Stats stats = netplay->GetStats();
+        std::cout << "Netplay: " << stats.rollbacks << " rollbacks of " << stats.resimulated_frames << " frames, longest "
+                  << stats.max_rollback_seconds * 1000.0 << " ms, " << stats.rollbacks_over_budget << " over budget, "
+                  << stats.stalls << " stalls" << std::endl;
+    }
     return EXIT_SUCCESS;
 }
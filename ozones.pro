@@ -1,15 +1,15 @@
 TEMPLATE = app
-CONFIG += console c++17
+CONFIG += console c++17 thread
 CONFIG -= app_bundle
 CONFIG -= qt
 
+include(core.pri)
+
 SOURCES += \
-    ram.cpp \
-    instruction.cpp \
-    cpu.cpp \
     ozones.cpp \
-    rom.cpp \
-    ppu.cpp
+    frame_pacer.cpp \
+    filter.cpp \
+    audio_output.cpp
 
 SUBDIRS += \
     ozones.pro
@@ -18,12 +18,10 @@ DISTFILES += \
     LICENSE
 
 HEADERS += \
-    ram.h \
-    instruction.h \
-    cpu.h \
-    rom.h \
-    ines.h \
-    ppu.h
+    triple_buffer.h \
+    frame_pacer.h \
+    filter.h \
+    audio_output.h
 
 unix|win32: LIBS += -lsfml-window \
     -lsfml-graphics \
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <vector>
+#include "state.h"
+
+namespace ozones {
+
+// Remembers the snapshot epoch in which each 64-byte page of a memory
+// region was last written, so incremental snapshots can copy only the
+// pages written since any earlier epoch, for any number of consumers.
+class PageTracker {
+public:
+    static constexpr int kPageBits = 6;
+    static constexpr size_t kPageSize = 1 << kPageBits;
+    explicit PageTracker(size_t size) : size_(size), pages_((size + kPageSize - 1) >> kPageBits), epoch_(1) { }
+    void MarkWritten(size_t offset) {
+        pages_[offset >> kPageBits] = epoch_;
+    }
+    void MarkAll() {
+        std::fill(pages_.begin(), pages_.end(), epoch_);
+    }
+    // Writes from now on are tagged with epoch
+    void SetEpoch(uint32_t epoch) {
+        epoch_ = epoch;
+    }
+    bool IsWrittenSince(size_t page, uint32_t epoch) {
+        return pages_[page] >= epoch;
+    }
+    // A bitmap of the pages written since epoch, followed by those pages
+    void SaveWrittenPages(StateWriter& writer, const uint8_t* memory, uint32_t since) {
+        for(size_t word = 0; word < pages_.size(); word += 64) {
+            uint64_t bits = 0;
+            for(size_t page = word; page < std::min(word + 64, pages_.size()); ++page) {
+                if(pages_[page] >= since)
+                    bits |= 1ULL << (page - word);
+            }
+            writer.Write(bits);
+        }
+        for(size_t page = 0; page < pages_.size(); ++page) {
+            if(pages_[page] >= since)
+                writer.Write(memory + (page << kPageBits), GetPageLength(page));
+        }
+    }
+    void LoadWrittenPages(StateReader& reader, uint8_t* memory) {
+        std::vector<uint64_t> bitmap((pages_.size() + 63) / 64);
+        for(auto& bits : bitmap)
+            reader.Read(bits);
+        // A truncated or forged bitmap must not select more than is left
+        size_t length = 0;
+        for(size_t page = 0; page < pages_.size(); ++page) {
+            if(bitmap[page / 64] & (1ULL << (page % 64)))
+                length += GetPageLength(page);
+        }
+        if(length > reader.GetRemaining())
+            throw std::runtime_error("Save state delta is truncated");
+        for(size_t page = 0; page < pages_.size(); ++page) {
+            if(bitmap[page / 64] & (1ULL << (page % 64))) {
+                reader.Read(memory + (page << kPageBits), GetPageLength(page));
+                pages_[page] = epoch_;
+            }
+        }
+    }
+    // Copies back from a full saved copy of the region only the pages written since epoch.
+    // Restored pages count as written, so deltas and restores against other snapshots see them.
+    void RestoreWrittenPages(const uint8_t* saved, uint8_t* memory, uint32_t since) {
+        for(size_t page = 0; page < pages_.size(); ++page) {
+            if(pages_[page] >= since) {
+                std::copy_n(saved + (page << kPageBits), GetPageLength(page), memory + (page << kPageBits));
+                pages_[page] = epoch_;
+            }
+        }
+    }
+    // Heap bytes of the epoch tags
+    size_t GetMemoryUsage() {
+        return pages_.capacity() * sizeof(uint32_t);
+    }
+private:
+    size_t GetPageLength(size_t page) {
+        return std::min(kPageSize, size_ - (page << kPageBits));
+    }
+    size_t size_;
+    std::vector<uint32_t> pages_;
+    uint32_t epoch_;
+};
+
+}
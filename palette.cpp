@@ -0,0 +1,135 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "palette.h"
+#include <immintrin.h>
+#include "ppu.h"
+#include "simd.h"
+
+namespace ozones {
+
+namespace {
+
+const uint8_t kColors[64][3] = {
+    {  84,  84,  84 }, {   0,  30, 116 }, {   8,  16, 144 }, {  48,   0, 136 },
+    {  68,   0, 100 }, {  92,   0,  48 }, {  84,   4,   0 }, {  60,  24,   0 },
+    {  32,  42,   0 }, {   8,  58,   0 }, {   0,  64,   0 }, {   0,  60,   0 },
+    {   0,  50,  60 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 152, 150, 152 }, {   8,  76, 196 }, {  48,  50, 236 }, {  92,  30, 228 },
+    { 136,  20, 176 }, { 160,  20, 100 }, { 152,  34,  32 }, { 120,  60,   0 },
+    {  84,  90,   0 }, {  40, 114,   0 }, {   8, 124,   0 }, {   0, 118,  40 },
+    {   0, 102, 120 }, {   0,   0,   0 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, {  76, 154, 236 }, { 120, 124, 236 }, { 176,  98, 236 },
+    { 228,  84, 236 }, { 236,  88, 180 }, { 236, 106, 100 }, { 212, 136,  32 },
+    { 160, 170,   0 }, { 116, 196,   0 }, {  76, 208,  32 }, {  56, 204, 108 },
+    {  56, 180, 204 }, {  60,  60,  60 }, {   0,   0,   0 }, {   0,   0,   0 },
+    { 236, 238, 236 }, { 168, 204, 236 }, { 188, 188, 236 }, { 212, 178, 236 },
+    { 236, 174, 236 }, { 236, 174, 212 }, { 236, 180, 176 }, { 228, 196, 144 },
+    { 204, 210, 120 }, { 180, 222, 120 }, { 168, 226, 144 }, { 152, 226, 180 },
+    { 160, 214, 228 }, { 160, 162, 160 }, {   0,   0,   0 }, {   0,   0,   0 }
+};
+
+// Each emphasis bit darkens the two other channels
+const float kEmphasisAttenuation = 0.816f;
+
+}
+
+const std::array<uint32_t, 8 * 64> Palette::kTable = Palette::BuildTable();
+const std::array<uint8_t, 8 * 3 * 64> Palette::kChannelTable = Palette::BuildChannelTable();
+
+void Palette::ConvertScanline(const uint8_t* indices, uint8_t mask, uint32_t* out, int width) {
+    int emphasis = (mask >> 5) & 0x7;
+    const uint32_t* table = &kTable[emphasis * 64];
+    uint8_t index_mask = (mask & Ppu::kGreyscale) ? 0x30 : 0x3F;
+    if(HasAvx2())
+        ConvertScanlineAvx2(&kChannelTable[emphasis * 3 * 64], table, index_mask, indices, out, width);
+    else
+        ConvertScanlineScalar(table, index_mask, indices, out, width);
+}
+
+std::array<uint32_t, 8 * 64> Palette::BuildTable() {
+    std::array<uint32_t, 8 * 64> table;
+    for(int emphasis = 0; emphasis < 8; ++emphasis) {
+        for(int color = 0; color < 64; ++color) {
+            uint32_t rgba = 0xFF000000;
+            for(int channel = 0; channel < 3; ++channel) {
+                float value = kColors[color][channel];
+                // Bit 0 is red, bit 1 green, bit 2 blue
+                for(int bit = 0; bit < 3; ++bit) {
+                    if(bit != channel && (emphasis & (1 << bit)))
+                        value *= kEmphasisAttenuation;
+                }
+                rgba |= (uint32_t) (value + 0.5f) << (channel * 8);
+            }
+            table[emphasis * 64 + color] = rgba;
+        }
+    }
+    return table;
+}
+
+std::array<uint8_t, 8 * 3 * 64> Palette::BuildChannelTable() {
+    std::array<uint8_t, 8 * 3 * 64> channels;
+    for(int emphasis = 0; emphasis < 8; ++emphasis) {
+        for(int channel = 0; channel < 3; ++channel) {
+            for(int color = 0; color < 64; ++color)
+                channels[(emphasis * 3 + channel) * 64 + color] = kTable[emphasis * 64 + color] >> (channel * 8);
+        }
+    }
+    return channels;
+}
+
+void Palette::ConvertScanlineScalar(const uint32_t* table, uint8_t index_mask, const uint8_t* indices, uint32_t* out, int width) {
+    for(int x = 0; x < width; ++x)
+        out[x] = table[indices[x] & index_mask];
+}
+
+__attribute__((target("avx2")))
+void Palette::ConvertScanlineAvx2(const uint8_t* channels, const uint32_t* table, uint8_t index_mask, const uint8_t* indices, uint32_t* out, int width) {
+    const __m256i mask = _mm256_set1_epi8(index_mask);
+    const __m256i select = _mm256_set1_epi8(0x70);
+    const __m256i sixteen = _mm256_set1_epi8(16);
+    const __m256i alpha = _mm256_set1_epi8((char) 0xFF);
+    // Each channel plane as four 16-entry shuffle tables
+    __m256i quarters[3][4];
+    for(int channel = 0; channel < 3; ++channel) {
+        for(int i = 0; i < 4; ++i)
+            quarters[channel][i] = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*) &channels[channel * 64 + i * 16]));
+    }
+    int x = 0;
+    for(; x + 32 <= width; x += 32) {
+        __m256i index = _mm256_and_si256(_mm256_loadu_si256((const __m256i*) &indices[x]), mask);
+        // Saturating add of 0x70 sets bit 7 (shuffle yields 0) unless the index
+        // falls within the quarter, after rebasing it by 16 per quarter
+        __m256i selectors[4];
+        for(int i = 0; i < 4; ++i) {
+            selectors[i] = _mm256_adds_epu8(index, select);
+            index = _mm256_sub_epi8(index, sixteen);
+        }
+        __m256i planes[3];
+        for(int channel = 0; channel < 3; ++channel) {
+            planes[channel] = _mm256_shuffle_epi8(quarters[channel][0], selectors[0]);
+            for(int i = 1; i < 4; ++i)
+                planes[channel] = _mm256_or_si256(planes[channel], _mm256_shuffle_epi8(quarters[channel][i], selectors[i]));
+        }
+        __m256i r = planes[0];
+        __m256i g = planes[1];
+        __m256i b = planes[2];
+        // Interleave the planes into RGBA; unpacks work within 128-bit lanes,
+        // so pixels come out as 0-3/16-19, 4-7/20-23 and so on
+        __m256i rg_low = _mm256_unpacklo_epi8(r, g);
+        __m256i rg_high = _mm256_unpackhi_epi8(r, g);
+        __m256i ba_low = _mm256_unpacklo_epi8(b, alpha);
+        __m256i ba_high = _mm256_unpackhi_epi8(b, alpha);
+        __m256i p0 = _mm256_unpacklo_epi16(rg_low, ba_low);
+        __m256i p1 = _mm256_unpackhi_epi16(rg_low, ba_low);
+        __m256i p2 = _mm256_unpacklo_epi16(rg_high, ba_high);
+        __m256i p3 = _mm256_unpackhi_epi16(rg_high, ba_high);
+        _mm256_storeu_si256((__m256i*) &out[x], _mm256_permute2x128_si256(p0, p1, 0x20));
+        _mm256_storeu_si256((__m256i*) &out[x + 8], _mm256_permute2x128_si256(p2, p3, 0x20));
+        _mm256_storeu_si256((__m256i*) &out[x + 16], _mm256_permute2x128_si256(p0, p1, 0x31));
+        _mm256_storeu_si256((__m256i*) &out[x + 24], _mm256_permute2x128_si256(p2, p3, 0x31));
+    }
+    ConvertScanlineScalar(table, index_mask, indices + x, out + x, width - x);
+}
+
+}
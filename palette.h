@@ -0,0 +1,24 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+namespace ozones {
+
+// Converts palette RAM values to host RGBA (R in the lowest byte) through a
+// precomputed 64 colour x 8 emphasis table
+class Palette {
+public:
+    // Converts one scanline using the greyscale and emphasis bits of PPUMASK
+    static void ConvertScanline(const uint8_t* indices, uint8_t mask, uint32_t* out, int width);
+private:
+    static std::array<uint32_t, 8 * 64> BuildTable();
+    static std::array<uint8_t, 8 * 3 * 64> BuildChannelTable();
+    static void ConvertScanlineScalar(const uint32_t* table, uint8_t index_mask, const uint8_t* indices, uint32_t* out, int width);
+    static void ConvertScanlineAvx2(const uint8_t* channels, const uint32_t* table, uint8_t index_mask, const uint8_t* indices, uint32_t* out, int width);
+    static const std::array<uint32_t, 8 * 64> kTable;
+    // kTable split into 64-byte R, G and B planes for in-register shuffle lookups
+    static const std::array<uint8_t, 8 * 3 * 64> kChannelTable;
+};
+
+}
@@ -2,30 +2,24 @@
 // PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
 
 #include "ppu.h"
+#include <algorithm>
 
 namespace ozones {
 
-Ppu::Ppu(std::shared_ptr<Ram> ppu_ram, std::shared_ptr<Ram> cpu_ram) {
-    palettes_ = std::make_shared<Ram>(0x20);
-    oam_ = std::make_shared<Ram>(0x100);
-    ram_ = std::make_shared<Ram>(0);
-    cpu_ram_ = cpu_ram;
-    for(size_t i = 0; i < 4; ++i) {
-        ram_->Map(ppu_ram, 0, i * 0x4000, 0x3F00);
-        ram_->Map(palettes_, 0x3F00, i * 0x4000 + 0x3F00, 0x100);
-    }
-}
+Ppu::Ppu(std::shared_ptr<Vram> vram, std::shared_ptr<Ram> cpu_ram) : oam_(), vram_(vram), cpu_ram_(cpu_ram), latch_(0), ppu_ctrl_(0), ppu_mask_(0), ppu_status_(0), oam_dma_(0), ppu_addr_(0), oam_addr_(0), fine_scroll_x_(0), fine_scroll_y_(0), oam_write_pair_(false), scroll_write_pair_(false), ppu_write_pair_(false), dot_(0), scanline_(0), frame_scroll_y_(0), render_mode_(kRenderFull), frame_render_mode_(kRenderTimingOnly), nmi_(false), frame_complete_(false), frame_index_(0), completed_frame_(nullptr) { }
 
 uint8_t Ppu::ReadByte(size_t addr) {
     switch(addr & 0x7) {
     case 2:
         scroll_write_pair_ = false;
         ppu_write_pair_ = false;
-        return latch_ = (ppu_status_ & 0xE0) | (latch_ & 0x1F);
+        latch_ = (ppu_status_ & 0xE0) | (latch_ & 0x1F);
+        ppu_status_ &= ~kVBlank;
+        return latch_;
     case 4:
-        return latch_ = oam_->ReadByte(oam_addr_);
+        return latch_ = oam_[oam_addr_ & 0xFF];
     case 7:
-        return latch_ = ram_->ReadByte(ppu_addr_);
+        return latch_ = vram_->ReadByte(ppu_addr_);
     default:
         return latch_;
     }
@@ -35,12 +29,15 @@ void Ppu::WriteByte(size_t addr, uint8_t value) {
     latch_ = value;
     if(addr == 0x4014) {
         for(size_t i = 0; i < 256; i++) {
-            uint8_t byte = cpu_ram_->ReadByte(((uint16_t) value << 8) + i);
-            oam_->WriteByte(i, byte);
+            oam_[i] = cpu_ram_->ReadByte(((uint16_t) value << 8) + i);
         }
+        return;
     }
     switch(addr & 0x7) {
     case 0:
+        // Enabling NMI during vblank raises it immediately
+        if(!(ppu_ctrl_ & kNmiEnable) && (value & kNmiEnable) && (ppu_status_ & kVBlank))
+            nmi_ = true;
         ppu_ctrl_ = value;
         break;
     case 1:
@@ -54,7 +51,7 @@ void Ppu::WriteByte(size_t addr, uint8_t value) {
         oam_write_pair_ = !oam_write_pair_;
         break;
     case 4:
-        oam_->WriteByte(oam_addr_, value);
+        oam_[oam_addr_ & 0xFF] = value;
         if(ppu_status_ & kVBlank)
             break;
         ++oam_addr_;
@@ -74,7 +71,7 @@ void Ppu::WriteByte(size_t addr, uint8_t value) {
         ppu_write_pair_ = !ppu_write_pair_;
         break;
     case 7:
-        ram_->WriteByte(ppu_addr_, value);
+        vram_->WriteByte(ppu_addr_, value);
         if(ppu_ctrl_ & kIncrementMode)
             ppu_addr_ += 32;
         else
@@ -83,4 +80,197 @@ void Ppu::WriteByte(size_t addr, uint8_t value) {
     }
 }
 
+void Ppu::Tick(int dots) {
+    dot_ += dots;
+    while(dot_ >= kDotsPerScanline) {
+        dot_ -= kDotsPerScanline;
+        EndScanline();
+    }
+}
+
+void Ppu::SetRenderMode(RenderMode mode) {
+    render_mode_ = mode;
+}
+
+bool Ppu::PollNmi() {
+    bool nmi = nmi_;
+    nmi_ = false;
+    return nmi;
+}
+
+bool Ppu::PollFrameComplete() {
+    bool frame_complete = frame_complete_;
+    frame_complete_ = false;
+    return frame_complete;
+}
+
+const FrameState* Ppu::GetCompletedFrame() {
+    return completed_frame_;
+}
+
+void Ppu::Reset() {
+    latch_ = 0;
+    ppu_ctrl_ = 0;
+    ppu_mask_ = 0;
+    fine_scroll_x_ = 0;
+    fine_scroll_y_ = 0;
+    oam_write_pair_ = false;
+    scroll_write_pair_ = false;
+    ppu_write_pair_ = false;
+    nmi_ = false;
+}
+
+size_t Ppu::GetMemoryUsage() {
+    size_t usage = sizeof(*this);
+    if(frames_) {
+        usage += sizeof(*frames_);
+        for(auto& frame : *frames_)
+            usage += frame.chr_ram.capacity();
+    }
+    return usage;
+}
+
+void Ppu::SaveState(StateWriter& writer) {
+    writer.Write(oam_);
+    writer.Write(latch_);
+    writer.Write(ppu_ctrl_);
+    writer.Write(ppu_mask_);
+    writer.Write(ppu_status_);
+    writer.Write(oam_dma_);
+    writer.Write(ppu_addr_);
+    writer.Write(oam_addr_);
+    writer.Write(fine_scroll_x_);
+    writer.Write(fine_scroll_y_);
+    writer.Write(oam_write_pair_);
+    writer.Write(scroll_write_pair_);
+    writer.Write(ppu_write_pair_);
+    writer.Write(dot_);
+    writer.Write(scanline_);
+    writer.Write(frame_scroll_y_);
+    writer.Write(nmi_);
+    writer.Write(frame_complete_);
+}
+
+void Ppu::LoadState(StateReader& reader) {
+    reader.Read(oam_);
+    reader.Read(latch_);
+    reader.Read(ppu_ctrl_);
+    reader.Read(ppu_mask_);
+    reader.Read(ppu_status_);
+    reader.Read(oam_dma_);
+    reader.Read(ppu_addr_);
+    reader.Read(oam_addr_);
+    reader.Read(fine_scroll_x_);
+    reader.Read(fine_scroll_y_);
+    reader.Read(oam_write_pair_);
+    reader.Read(scroll_write_pair_);
+    reader.Read(ppu_write_pair_);
+    reader.Read(dot_);
+    reader.Read(scanline_);
+    reader.Read(frame_scroll_y_);
+    reader.Read(nmi_);
+    reader.Read(frame_complete_);
+}
+
+void Ppu::EndScanline() {
+    if(scanline_ < kScreenHeight) {
+        ScanlineState state = CaptureScanline();
+        if(frame_render_mode_ == kRenderFull)
+            (*frames_)[frame_index_].scanlines[scanline_] = state;
+        ProbeScanline(scanline_, state);
+    }
+    if(++scanline_ == kScanlinesPerFrame)
+        scanline_ = 0;
+    if(scanline_ == kScreenHeight + 1) {
+        ppu_status_ |= kVBlank;
+        frame_complete_ = true;
+        if(ppu_ctrl_ & kNmiEnable)
+            nmi_ = true;
+        if(frame_render_mode_ == kRenderFull)
+            FinishFrameState();
+        else
+            completed_frame_ = nullptr;
+    } else if(scanline_ == kScanlinesPerFrame - 1) {
+        // Pre-render scanline
+        ppu_status_ &= ~(kVBlank | kSpriteZeroHit | kSpriteOverflow);
+        frame_scroll_y_ = fine_scroll_y_ + ((ppu_ctrl_ & 0x02) ? kScreenHeight : 0);
+        // The frame in progress at power-on isn't drawn, as it wasn't logged from its start
+        frame_render_mode_ = render_mode_;
+        if(frame_render_mode_ == kRenderFull && !frames_)
+            frames_ = std::make_unique<std::array<FrameState, 2>>();
+    }
+}
+
+// Sprite evaluation and sprite 0 hit against the live PPU memory; pixels are left to the Renderer
+void Ppu::ProbeScanline(int line, const ScanlineState& state) {
+    if(!(ppu_mask_ & (kBackgroundEnable | kSpriteEnable)))
+        return;
+    PpuMemoryView memory = GetLiveView();
+    uint8_t evaluated[9];
+    int count = Renderer::EvaluateSprites(memory, state, line, evaluated);
+    if(count > 8)
+        ppu_status_ |= kSpriteOverflow;
+    if((ppu_status_ & kSpriteZeroHit) || count == 0 || evaluated[0] != 0)
+        return;
+    if((ppu_mask_ & (kBackgroundEnable | kSpriteEnable)) != (kBackgroundEnable | kSpriteEnable))
+        return;
+    // Opaque-pixel mask of sprite 0 against the background under it, MSB leftmost
+    uint8_t low, high;
+    Renderer::FetchSpriteRow(memory, state, line, &oam_[0], low, high);
+    uint8_t sprite_mask = low | high;
+    int x_start = oam_[3];
+    int x_end = std::min(x_start + 8, kScreenWidth - 1);
+    std::array<uint8_t, kScreenWidth> background;
+    Renderer::RenderBackground(memory, state, line, x_start, x_end, background.data());
+    uint8_t background_mask = 0;
+    for(int x = x_start; x < x_end; ++x) {
+        if(x < 8 && (ppu_mask_ & (kBackgroundLeftColumnEnable | kSpriteLeftColumnEnable)) != (kBackgroundLeftColumnEnable | kSpriteLeftColumnEnable))
+            continue;
+        if(background[x] & 0x03)
+            background_mask |= 0x80 >> (x - x_start);
+    }
+    if(sprite_mask & background_mask)
+        ppu_status_ |= kSpriteZeroHit;
+}
+
+// Copies the memory the logged scanlines refer to and flips to the other frame buffer
+void Ppu::FinishFrameState() {
+    FrameState& frame = (*frames_)[frame_index_];
+    std::copy_n(vram_->GetCiram(), frame.ciram.size(), frame.ciram.begin());
+    std::copy_n(vram_->GetPalettes(), frame.palettes.size(), frame.palettes.begin());
+    frame.oam = oam_;
+    if(vram_->IsChrWritable()) {
+        frame.chr_ram.assign(vram_->GetChr(), vram_->GetChr() + vram_->GetChrSize());
+        frame.chr = frame.chr_ram.data();
+    } else {
+        frame.chr = vram_->GetChr();
+    }
+    completed_frame_ = &frame;
+    frame_index_ ^= 1;
+}
+
+ScanlineState Ppu::CaptureScanline() {
+    ScanlineState state;
+    state.ctrl = ppu_ctrl_;
+    state.mask = ppu_mask_;
+    state.scroll_x = fine_scroll_x_ + ((ppu_ctrl_ & 0x01) ? kScreenWidth : 0);
+    state.scroll_y = frame_scroll_y_;
+    for(size_t i = 0; i < 4; ++i)
+        state.nametable_banks[i] = vram_->GetNametableBank(i);
+    for(size_t i = 0; i < 8; ++i)
+        state.pattern_banks[i] = vram_->GetPatternBank(i);
+    return state;
+}
+
+PpuMemoryView Ppu::GetLiveView() {
+    PpuMemoryView view;
+    for(size_t i = 0; i < 4; ++i)
+        view.nametables[i] = vram_->GetNametablePage(i);
+    for(size_t i = 0; i < 8; ++i)
+        view.patterns[i] = vram_->GetPatternPage(i);
+    view.palettes = vram_->GetPalettes();
+    view.oam = oam_.data();
+    return view;
+}
+
 }
@@ -1,8 +1,12 @@
 #pragma once
 
+#include <array>
 #include <cstdint>
 #include <memory>
 #include "ram.h"
+#include "renderer.h"
+#include "state.h"
+#include "vram.h"
 
 namespace ozones {
 
@@ -32,19 +36,57 @@ public:
         kSpriteZeroHit  = 0x40,
         kVBlank         = 0x80
     };
-    Ppu(std::shared_ptr<Ram> ppu_ram, std::shared_ptr<Ram> cpu_ram);
+    // Status flags and NMI timing are always produced inline; kRenderFull
+    // additionally logs the per-scanline state the Renderer draws from
+    enum RenderMode {
+        kRenderFull,
+        kRenderTimingOnly
+    };
+    static const int kScreenWidth = Renderer::kScreenWidth;
+    static const int kScreenHeight = Renderer::kScreenHeight;
+    static const int kDotsPerScanline = 341;
+    static const int kScanlinesPerFrame = 262;
+    Ppu(std::shared_ptr<Vram> vram, std::shared_ptr<Ram> cpu_ram);
     uint8_t ReadByte(size_t addr) override;
     void WriteByte(size_t addr, uint8_t value) override;
+    void Tick(int dots);
+    // Takes effect from the next pre-render scanline so a frame is never half rendered
+    void SetRenderMode(RenderMode mode);
+    bool PollNmi();
+    bool PollFrameComplete();
+    // The frame that just completed if it was run in kRenderFull, otherwise null.
+    // It stays valid until the end of the next frame.
+    const FrameState* GetCompletedFrame();
+    // The reset line clears PPUCTRL, PPUMASK, scrolling and the write toggles; memory and OAM are kept
+    void Reset();
+    // Registers, OAM and timing; the render mode and logged frames are host-side
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+    // Object and heap bytes, the frame logs included once allocated
+    size_t GetMemoryUsage();
 private:
-    std::shared_ptr<Ram> palettes_;
-    std::shared_ptr<Ram> oam_;
-    std::shared_ptr<Ram> ram_;
+    void EndScanline();
+    void ProbeScanline(int line, const ScanlineState& state);
+    void FinishFrameState();
+    ScanlineState CaptureScanline();
+    PpuMemoryView GetLiveView();
+    std::array<uint8_t, 0x100> oam_;
+    std::shared_ptr<Vram> vram_;
     std::shared_ptr<Ram> cpu_ram_;
     uint8_t latch_;
     uint8_t ppu_ctrl_, ppu_mask_, ppu_status_, oam_dma_;
     uint16_t ppu_addr_, oam_addr_;
     uint8_t fine_scroll_x_, fine_scroll_y_;
     bool oam_write_pair_, scroll_write_pair_, ppu_write_pair_;
+    int dot_, scanline_;
+    uint16_t frame_scroll_y_;
+    RenderMode render_mode_, frame_render_mode_;
+    bool nmi_, frame_complete_;
+    // Recorded into alternately so the renderer can draw one while the other fills
+    // Allocated by the first frame rendered in full
+    std::unique_ptr<std::array<FrameState, 2>> frames_;
+    size_t frame_index_;
+    const FrameState* completed_frame_;
 };
 
 }
@@ -15,7 +15,7 @@ void Mappable::WriteWord(size_t addr, uint16_t value) {
 }
 
 
-Ram::Ram(size_t size) : size_(size), contents_(size) { }
+Ram::Ram(size_t size) : size_(size), contents_(size), pages_(size) { }
 
 uint8_t Ram::ReadByte(size_t addr) {
     for(auto& mapping : mappings_) {
@@ -36,12 +36,46 @@ void Ram::WriteByte(size_t addr, uint8_t value) {
     }
     addr %= size_;
     contents_[addr] = value;
+    pages_.MarkWritten(addr);
 }
 
 void Ram::Map(std::shared_ptr<Mappable> destination, size_t source_start, size_t dest_start, size_t length) {
     mappings_.push_back(Mapping(destination, source_start, dest_start, length));
 }
 
+const uint8_t* Ram::GetContents() {
+    return contents_.data();
+}
+
+size_t Ram::GetMemoryUsage() {
+    return sizeof(*this) + contents_.capacity() + mappings_.capacity() * sizeof(Mapping) + pages_.GetMemoryUsage();
+}
+
+void Ram::SaveState(StateWriter& writer) {
+    writer.Write(contents_.data(), contents_.size());
+}
+
+void Ram::LoadState(StateReader& reader) {
+    reader.Read(contents_.data(), contents_.size());
+    pages_.MarkAll();
+}
+
+void Ram::SetStateEpoch(uint32_t epoch) {
+    pages_.SetEpoch(epoch);
+}
+
+void Ram::SaveStateDelta(StateWriter& writer, uint32_t since) {
+    pages_.SaveWrittenPages(writer, contents_.data(), since);
+}
+
+void Ram::LoadStateDelta(StateReader& reader) {
+    pages_.LoadWrittenPages(reader, contents_.data());
+}
+
+void Ram::RestoreState(StateReader& reader, uint32_t since) {
+    pages_.RestoreWrittenPages(reader.ReadSpan(contents_.size()), contents_.data(), since);
+}
+
 Ram::Mapping::Mapping(std::shared_ptr<Mappable> destination, size_t source_start, size_t dest_start, size_t length) : destination(destination), source_start(source_start), dest_start(dest_start), length(length) { }
 
 }
@@ -3,6 +3,8 @@
 #include <cstdint>
 #include <memory>
 #include <vector>
+#include "page_tracker.h"
+#include "state.h"
 
 namespace ozones {
 
@@ -20,6 +22,18 @@ public:
     uint8_t ReadByte(size_t addr) override;
     void WriteByte(size_t addr, uint8_t value) override;
     void Map(std::shared_ptr<Mappable> destination, size_t source_start, size_t dest_start, size_t length);
+    const uint8_t* GetContents();
+    // Only the contents; mappings are part of the machine's construction
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+    // Incremental counterparts covering only the pages written since epoch
+    void SetStateEpoch(uint32_t epoch);
+    void SaveStateDelta(StateWriter& writer, uint32_t since);
+    void LoadStateDelta(StateReader& reader);
+    // Loads a full SaveState section, copying only the pages written since epoch
+    void RestoreState(StateReader& reader, uint32_t since);
+    // Object and heap bytes; mapped devices count separately
+    size_t GetMemoryUsage();
 private:
     struct Mapping {
         Mapping(std::shared_ptr<Mappable>, size_t source_start, size_t dest_start, size_t length);
@@ -31,6 +45,7 @@ private:
     size_t size_;
     std::vector<uint8_t> contents_;
     std::vector<Mapping> mappings_;
+    PageTracker pages_;
 };
 
 }
@@ -0,0 +1,125 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "capture.h"
+#include "machine.h"
+#include "movie.h"
+
+using namespace ozones;
+
+namespace {
+
+struct Options {
+    std::string rom;
+    std::string movie;
+    uint64_t frames;
+    std::string video;
+    std::string audio;
+    uint32_t sample_rate;
+};
+
+int Record(const Options& options) {
+    std::ifstream rom(options.rom, std::ios::in | std::ios::binary);
+    if(!rom)
+        throw std::runtime_error("Cannot open " + options.rom);
+    Machine machine(rom, std::thread::hardware_concurrency());
+    std::unique_ptr<MovieReader> movie;
+    uint64_t frames = options.frames;
+    if(!options.movie.empty()) {
+        movie = std::make_unique<MovieReader>(options.movie);
+        if(movie->GetRomHash() != machine.GetRomHash())
+            throw std::runtime_error("Movie was recorded with another ROM");
+        frames = movie->GetFrameCount();
+    }
+    std::unique_ptr<VideoCapture> video;
+    if(!options.video.empty())
+        video = std::make_unique<VideoCapture>(options.video, VideoCapture::GetFormatForPath(options.video));
+    std::unique_ptr<AudioCapture> audio;
+    std::vector<int16_t> samples;
+    if(!options.audio.empty()) {
+        machine.SetSampleRate(options.sample_rate);
+        audio = std::make_unique<AudioCapture>(options.audio, options.sample_rate);
+        samples.resize(options.sample_rate / 30);
+    } else {
+        machine.SetAudioEnabled(false);
+    }
+    int64_t diverged = -1;
+    auto start = std::chrono::steady_clock::now();
+    for(uint64_t frame = 0; frame < frames; ++frame) {
+        uint16_t input = movie ? movie->GetInput(frame) : 0;
+        machine.SetButtons(0, input & 0xFF);
+        machine.SetButtons(1, input >> 8);
+        machine.RunFrame(video ? Ppu::kRenderFull : Ppu::kRenderTimingOnly);
+        if(video)
+            video->AddFrame(machine.GetRgbaFramebuffer());
+        if(audio) {
+            size_t count;
+            while((count = machine.ReadSamples(samples.data(), samples.size())) != 0)
+                audio->AddSamples(samples.data(), count);
+        }
+        if(movie && diverged < 0 && movie->HasHash(frame) && !movie->MatchesHash(frame, machine.GetStateHash()))
+            diverged = (int64_t) frame;
+    }
+    if(video)
+        video->Finish();
+    if(audio)
+        audio->Finish();
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    // Standard output may be one of the captures
+    std::cerr << frames << " frames, " << frames / elapsed.count() << " fps";
+    if(video)
+        std::cerr << ", video stalled " << video->GetStallSeconds() << " s";
+    if(audio)
+        std::cerr << ", audio stalled " << audio->GetStallSeconds() << " s";
+    std::cerr << std::endl;
+    if(diverged >= 0) {
+        std::cerr << "Diverged from the recording at frame " << diverged << std::endl;
+        return EXIT_FAILURE;
+    }
+    return EXIT_SUCCESS;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    // ozones-record (--movie file | --frames N) [--video file] [--audio file] [--sample-rate N] rom
+    Options options = {};
+    options.sample_rate = 48000;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--movie" && i + 1 < argc)
+            options.movie = argv[++i];
+        else if(arg == "--frames" && i + 1 < argc)
+            options.frames = std::strtoull(argv[++i], nullptr, 10);
+        else if(arg == "--video" && i + 1 < argc)
+            options.video = argv[++i];
+        else if(arg == "--audio" && i + 1 < argc)
+            options.audio = argv[++i];
+        else if(arg == "--sample-rate" && i + 1 < argc)
+            options.sample_rate = (uint32_t) std::atoi(argv[++i]);
+        else
+            options.rom = arg;
+    }
+    if(options.rom.empty() || (options.movie.empty() && options.frames == 0) || options.sample_rate == 0) {
+        std::cerr << "Usage: " << argv[0] << " (--movie file | --frames N) [--video file] [--audio file] [--sample-rate N] rom" << std::endl;
+        std::cerr << "Captures go to files or pipes, \"-\" is standard output; .rgb video is raw RGB24, anything else Y4M" << std::endl;
+        return EXIT_FAILURE;
+    }
+    try {
+        return Record(options);
+    } catch(std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+}
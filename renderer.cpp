@@ -0,0 +1,187 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "renderer.h"
+#include <algorithm>
+#include <cstring>
+#include "palette.h"
+#include "ppu.h"
+
+namespace ozones {
+
+Renderer::Renderer(unsigned threads) : pool_(threads), framebuffer_(), rgba_framebuffer_(), row_hashes_() { }
+
+void Renderer::Submit(const FrameState* frame) {
+    if(pool_.GetThreadCount() == 0) {
+        RenderLines(*frame, 0, kScreenHeight);
+        return;
+    }
+    pool_.Dispatch(kScreenHeight / kLinesPerJob, [this, frame](size_t job) {
+        RenderLines(*frame, job * kLinesPerJob, (job + 1) * kLinesPerJob);
+    });
+}
+
+void Renderer::Wait() {
+    pool_.Wait();
+}
+
+const uint8_t* Renderer::GetFramebuffer() {
+    Wait();
+    return framebuffer_.data();
+}
+
+const uint32_t* Renderer::GetRgbaFramebuffer() {
+    Wait();
+    return rgba_framebuffer_.data();
+}
+
+const uint64_t* Renderer::GetRowHashes() {
+    Wait();
+    return row_hashes_.data();
+}
+
+uint64_t Renderer::HashRow(const uint8_t* indices, uint8_t mask) {
+    uint64_t hash = 0xCBF29CE484222325ULL ^ (mask & (Ppu::kGreyscale | Ppu::kEmphasisRed | Ppu::kEmphasisGreen | Ppu::kEmphasisBlue));
+    for(int x = 0; x < kScreenWidth; x += 8) {
+        uint64_t chunk;
+        std::memcpy(&chunk, &indices[x], sizeof(chunk));
+        hash = (hash ^ chunk) * 0x9E3779B97F4A7C15ULL;
+        hash ^= hash >> 29;
+    }
+    return hash;
+}
+
+void Renderer::RenderLines(const FrameState& frame, int first, int last) {
+    for(int line = first; line < last; ++line) {
+        const ScanlineState& state = frame.scanlines[line];
+        uint8_t* indices = &framebuffer_[line * kScreenWidth];
+        RenderScanline(GetView(frame, state), state, line, indices);
+        // The RGBA row still holds the previous frame's conversion
+        uint64_t hash = HashRow(indices, state.mask);
+        if(hash == row_hashes_[line])
+            continue;
+        row_hashes_[line] = hash;
+        Palette::ConvertScanline(indices, state.mask, &rgba_framebuffer_[line * kScreenWidth], kScreenWidth);
+    }
+}
+
+PpuMemoryView Renderer::GetView(const FrameState& frame, const ScanlineState& state) {
+    PpuMemoryView view;
+    for(size_t i = 0; i < 4; ++i)
+        view.nametables[i] = &frame.ciram[state.nametable_banks[i] * 0x400];
+    for(size_t i = 0; i < 8; ++i)
+        view.patterns[i] = frame.chr + state.pattern_banks[i] * 0x400;
+    view.palettes = frame.palettes.data();
+    view.oam = frame.oam.data();
+    return view;
+}
+
+void Renderer::RenderScanline(const PpuMemoryView& memory, const ScanlineState& state, int line, uint8_t* out) {
+    if(!(state.mask & (Ppu::kBackgroundEnable | Ppu::kSpriteEnable))) {
+        std::fill(out, out + kScreenWidth, memory.palettes[0]);
+        return;
+    }
+    std::array<uint8_t, kScreenWidth> background = {};
+    if(state.mask & Ppu::kBackgroundEnable) {
+        RenderBackground(memory, state, line, 0, kScreenWidth, background.data());
+        if(!(state.mask & Ppu::kBackgroundLeftColumnEnable))
+            std::fill(background.begin(), background.begin() + 8, 0);
+    }
+    // Bits 0-3 as for the background, bit 4 set when behind the background
+    std::array<uint8_t, kScreenWidth> sprites = {};
+    if(state.mask & Ppu::kSpriteEnable) {
+        uint8_t evaluated[9];
+        int count = std::min(EvaluateSprites(memory, state, line, evaluated), 8);
+        // Lower OAM indices win, so draw back to front
+        for(int i = count - 1; i >= 0; --i) {
+            const uint8_t* sprite = &memory.oam[evaluated[i] * 4];
+            uint8_t low, high;
+            FetchSpriteRow(memory, state, line, sprite, low, high);
+            uint8_t attributes = (sprite[2] & kSpritePalette) << 2;
+            if(sprite[2] & kSpritePriority)
+                attributes |= 0x10;
+            for(int j = 0; j < 8; ++j) {
+                int x = sprite[3] + j;
+                if(x >= kScreenWidth)
+                    break;
+                uint8_t color = ((low >> (7 - j)) & 1) | (((high >> (7 - j)) & 1) << 1);
+                if(color)
+                    sprites[x] = attributes | color;
+            }
+        }
+        if(!(state.mask & Ppu::kSpriteLeftColumnEnable))
+            std::fill(sprites.begin(), sprites.begin() + 8, 0);
+    }
+    for(int x = 0; x < kScreenWidth; ++x) {
+        uint8_t bg = background[x];
+        uint8_t sp = sprites[x];
+        uint8_t index;
+        if((sp & 0x03) && (!(bg & 0x03) || !(sp & 0x10)))
+            index = 0x10 | (sp & 0x0F);
+        else
+            index = bg & 0x0F;
+        out[x] = memory.palettes[index];
+    }
+}
+
+void Renderer::RenderBackground(const PpuMemoryView& memory, const ScanlineState& state, int line, int x_start, int x_end, uint8_t* out) {
+    size_t pattern_page = (state.ctrl & Ppu::kBackgroundTileSelect) ? 4 : 0;
+    int y = (state.scroll_y + line) % (2 * kScreenHeight);
+    int nametable_y = y >= kScreenHeight ? 2 : 0;
+    y %= kScreenHeight;
+    int tile_y = y / 8;
+    int x = x_start;
+    while(x < x_end) {
+        int world_x = (state.scroll_x + x) % (2 * kScreenWidth);
+        const uint8_t* nametable = memory.nametables[nametable_y | (world_x >= kScreenWidth ? 1 : 0)];
+        int tile_x = (world_x % kScreenWidth) / 8;
+        uint8_t tile = nametable[tile_y * 32 + tile_x];
+        uint8_t attribute = nametable[0x3C0 + (tile_y / 4) * 8 + tile_x / 4];
+        uint8_t palette = ((attribute >> (((tile_y & 2) << 1) | (tile_x & 2))) & 0x03) << 2;
+        uint16_t pattern = tile * 16 + (y & 7);
+        const uint8_t* page = memory.patterns[pattern_page + (pattern >> 10)];
+        uint8_t low = page[pattern & 0x3FF];
+        uint8_t high = page[(pattern + 8) & 0x3FF];
+        for(int fine_x = world_x & 7; fine_x < 8 && x < x_end; ++fine_x, ++x) {
+            uint8_t color = ((low >> (7 - fine_x)) & 1) | (((high >> (7 - fine_x)) & 1) << 1);
+            out[x] = color ? (palette | color) : 0;
+        }
+    }
+}
+
+int Renderer::EvaluateSprites(const PpuMemoryView& memory, const ScanlineState& state, int line, uint8_t* sprites) {
+    int height = (state.ctrl & Ppu::kSpriteHeight) ? 16 : 8;
+    int count = 0;
+    for(int i = 0; i < 64 && count < 9; ++i) {
+        // Sprite data is delayed by one scanline
+        int row = line - memory.oam[i * 4] - 1;
+        if(row >= 0 && row < height)
+            sprites[count++] = i;
+    }
+    return count;
+}
+
+bool Renderer::FetchSpriteRow(const PpuMemoryView& memory, const ScanlineState& state, int line, const uint8_t* sprite, uint8_t& low, uint8_t& high) {
+    int height = (state.ctrl & Ppu::kSpriteHeight) ? 16 : 8;
+    int row = line - sprite[0] - 1;
+    if(row < 0 || row >= height)
+        return false;
+    if(sprite[2] & kSpriteFlipY)
+        row = height - 1 - row;
+    uint16_t pattern;
+    if(height == 16)
+        pattern = ((sprite[1] & 0x01) ? 0x1000 : 0x0000) + (sprite[1] & 0xFE) * 16 + (row >= 8 ? 16 : 0) + (row & 7);
+    else
+        pattern = ((state.ctrl & Ppu::kSpriteTileSelect) ? 0x1000 : 0x0000) + sprite[1] * 16 + row;
+    const uint8_t* page = memory.patterns[pattern >> 10];
+    low = page[pattern & 0x3FF];
+    high = page[(pattern + 8) & 0x3FF];
+    if(sprite[2] & kSpriteFlipX) {
+        // Reverse the bit order
+        low = (low * 0x0202020202ULL & 0x010884422010ULL) % 1023;
+        high = (high * 0x0202020202ULL & 0x010884422010ULL) % 1023;
+    }
+    return true;
+}
+
+}
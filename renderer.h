@@ -0,0 +1,78 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+#include "thread_pool.h"
+
+namespace ozones {
+
+// PPU register state a visible scanline depends on, logged once per line
+struct ScanlineState {
+    uint8_t ctrl;
+    uint8_t mask;
+    uint16_t scroll_x;
+    uint16_t scroll_y;
+    std::array<uint8_t, 4> nametable_banks;
+    std::array<uint16_t, 8> pattern_banks;
+};
+
+// Everything needed to draw a frame after the emulation has moved on
+struct FrameState {
+    std::array<ScanlineState, 240> scanlines;
+    std::array<uint8_t, 0x1000> ciram;
+    std::array<uint8_t, 0x20> palettes;
+    std::array<uint8_t, 0x100> oam;
+    // Cartridge CHR ROM, or chr_ram below for boards with writable CHR
+    const uint8_t* chr;
+    std::vector<uint8_t> chr_ram;
+};
+
+// Raw 1 KiB page views of PPU memory a scanline is drawn from
+struct PpuMemoryView {
+    std::array<const uint8_t*, 4> nametables;
+    std::array<const uint8_t*, 8> patterns;
+    const uint8_t* palettes;
+    const uint8_t* oam;
+};
+
+class Renderer {
+public:
+    static const int kScreenWidth = 256;
+    static const int kScreenHeight = 240;
+    // With no threads frames are drawn synchronously by Submit
+    Renderer(unsigned threads);
+    // Starts drawing the frame; it must stay untouched until the next Submit or Wait
+    void Submit(const FrameState* frame);
+    void Wait();
+    // Palette RAM values (6-bit colour indices), one byte per pixel
+    const uint8_t* GetFramebuffer();
+    // The same frame converted to RGBA with each scanline's greyscale and emphasis bits
+    const uint32_t* GetRgbaFramebuffer();
+    // Per-scanline hash of the colour indices and colour-affecting PPUMASK bits,
+    // so later stages can skip rows that didn't change since an earlier frame
+    const uint64_t* GetRowHashes();
+    static uint64_t HashRow(const uint8_t* indices, uint8_t mask);
+    static PpuMemoryView GetView(const FrameState& frame, const ScanlineState& state);
+    static void RenderScanline(const PpuMemoryView& memory, const ScanlineState& state, int line, uint8_t* out);
+    // Low 2 bits of each pixel are the pattern colour, bits 2-3 the palette; 0 means transparent
+    static void RenderBackground(const PpuMemoryView& memory, const ScanlineState& state, int line, int x_start, int x_end, uint8_t* out);
+    // Returns the number of sprites on the line, up to 9 so callers can detect overflow
+    static int EvaluateSprites(const PpuMemoryView& memory, const ScanlineState& state, int line, uint8_t* sprites);
+    static bool FetchSpriteRow(const PpuMemoryView& memory, const ScanlineState& state, int line, const uint8_t* sprite, uint8_t& low, uint8_t& high);
+private:
+    enum SpriteAttributes {
+        kSpritePalette  = 0x03,
+        kSpritePriority = 0x20,
+        kSpriteFlipX    = 0x40,
+        kSpriteFlipY    = 0x80
+    };
+    static const int kLinesPerJob = 8;
+    void RenderLines(const FrameState& frame, int first, int last);
+    ThreadPool pool_;
+    std::array<uint8_t, kScreenWidth * kScreenHeight> framebuffer_;
+    std::array<uint32_t, kScreenWidth * kScreenHeight> rgba_framebuffer_;
+    std::array<uint64_t, kScreenHeight> row_hashes_;
+};
+
+}
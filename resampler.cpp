@@ -0,0 +1,182 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "resampler.h"
+#include <algorithm>
+#include <cmath>
+#include <immintrin.h>
+#include "simd.h"
+
+namespace ozones {
+
+namespace {
+
+// Sum of history[i] * (taps[i] + t * deltas[i])
+float InterpolatedDotScalar(const float* history, const float* taps, const float* deltas, float t, int count) {
+    float sum = 0;
+    for(int i = 0; i < count; ++i)
+        sum += history[i] * (taps[i] + t * deltas[i]);
+    return sum;
+}
+
+// count must be a multiple of 4
+float InterpolatedDotSse(const float* history, const float* taps, const float* deltas, float t, int count) {
+    __m128 sum = _mm_setzero_ps();
+    __m128 tv = _mm_set1_ps(t);
+    for(int i = 0; i < count; i += 4) {
+        __m128 coefficients = _mm_add_ps(_mm_loadu_ps(taps + i), _mm_mul_ps(tv, _mm_loadu_ps(deltas + i)));
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(history + i), coefficients));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    return _mm_cvtss_f32(sum);
+}
+
+// count must be a multiple of 8
+__attribute__((target("avx2")))
+float InterpolatedDotAvx2(const float* history, const float* taps, const float* deltas, float t, int count) {
+    __m256 sum = _mm256_setzero_ps();
+    __m256 tv = _mm256_set1_ps(t);
+    for(int i = 0; i < count; i += 8) {
+        __m256 coefficients = _mm256_add_ps(_mm256_loadu_ps(taps + i), _mm256_mul_ps(tv, _mm256_loadu_ps(deltas + i)));
+        sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_loadu_ps(history + i), coefficients));
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sum), _mm256_extractf128_ps(sum, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    half = _mm_add_ss(half, _mm_shuffle_ps(half, half, 1));
+    return _mm_cvtss_f32(half);
+}
+
+int16_t ToSample(float value) {
+    return (int16_t) std::max(-32768.0f, std::min(32767.0f, std::nearbyint(value)));
+}
+
+}
+
+Resampler::Resampler(double input_rate, double output_rate, Quality quality) : input_rate_(input_rate), output_rate_(output_rate), adjustment_(1.0), quality_(quality), max_kernel_(kAvx2), position_(0) {
+    BuildTable();
+    UpdateStep();
+    Reset();
+}
+
+void Resampler::SetRates(double input_rate, double output_rate) {
+    input_rate_ = input_rate;
+    output_rate_ = output_rate;
+    BuildTable();
+    UpdateStep();
+}
+
+void Resampler::SetRateAdjustment(double factor) {
+    adjustment_ = factor;
+    UpdateStep();
+}
+
+void Resampler::SetQuality(Quality quality) {
+    if(quality == quality_)
+        return;
+    // The history is kept, only realigned so the output stays continuous
+    int old_taps = taps_;
+    quality_ = quality;
+    BuildTable();
+    int shift = (taps_ / 2 - 1) - (old_taps / 2 - 1);
+    if(shift > 0)
+        history_.insert(history_.begin(), shift, history_.empty() ? 0.0f : history_.front());
+    else
+        history_.erase(history_.begin(), history_.begin() + std::min<size_t>(-shift, history_.size()));
+}
+
+Resampler::Quality Resampler::GetQuality() {
+    return quality_;
+}
+
+void Resampler::SetMaxKernel(Kernel kernel) {
+    max_kernel_ = kernel;
+}
+
+Resampler::Kernel Resampler::GetKernel() {
+    if(max_kernel_ >= kAvx2 && taps_ % 8 == 0 && HasAvx2())
+        return kAvx2;
+    if(max_kernel_ >= kSse && taps_ % 4 == 0)
+        return kSse;
+    return kScalar;
+}
+
+void Resampler::Process(const int16_t* in, size_t count, std::vector<int16_t>& out) {
+    history_.insert(history_.end(), in, in + count);
+    size_t row = 2 * taps_;
+    Kernel kernel = GetKernel();
+    while((position_ >> kTimeBits) + taps_ <= history_.size()) {
+        const float* history = &history_[position_ >> kTimeBits];
+        uint64_t phase_position = (position_ & ((1ULL << kTimeBits) - 1)) * kPhases;
+        const float* taps = &table_[(phase_position >> kTimeBits) * row];
+        float t = (float) (phase_position & ((1ULL << kTimeBits) - 1)) * (1.0f / 4294967296.0f);
+        float value;
+        if(kernel == kAvx2)
+            value = InterpolatedDotAvx2(history, taps, taps + taps_, t, taps_);
+        else if(kernel == kSse)
+            value = InterpolatedDotSse(history, taps, taps + taps_, t, taps_);
+        else
+            value = InterpolatedDotScalar(history, taps, taps + taps_, t, taps_);
+        out.push_back(ToSample(value));
+        position_ += step_;
+    }
+    size_t consumed = std::min<size_t>(position_ >> kTimeBits, history_.size());
+    history_.erase(history_.begin(), history_.begin() + consumed);
+    position_ -= (uint64_t) consumed << kTimeBits;
+}
+
+void Resampler::Reset() {
+    history_.assign(taps_, 0.0f);
+    position_ = 0;
+}
+
+void Resampler::UpdateStep() {
+    step_ = (uint64_t) std::llround(input_rate_ / (output_rate_ * adjustment_) * (double) (1ULL << kTimeBits));
+}
+
+// Blackman-windowed sinc with its cutoff at 90% of the lower of the two
+// Nyquist frequencies, each phase normalised to unity gain at DC
+void Resampler::BuildTable() {
+    const double kPi = 3.14159265358979323846;
+    switch(quality_) {
+    case kLinear:
+        taps_ = 2;
+        break;
+    case kNormal:
+        taps_ = 32;
+        break;
+    case kHigh:
+        taps_ = 64;
+        break;
+    }
+    double cutoff = 0.9 * std::min(1.0, output_rate_ / input_rate_);
+    std::vector<double> rows((kPhases + 1) * taps_);
+    for(int phase = 0; phase <= kPhases; ++phase) {
+        double* taps = &rows[phase * taps_];
+        double total = 0;
+        for(int i = 0; i < taps_; ++i) {
+            double x = i - (taps_ / 2 - 1) - (double) phase / kPhases;
+            if(quality_ == kLinear) {
+                taps[i] = std::max(0.0, 1.0 - std::abs(x));
+            } else {
+                double sinc = x == 0 ? 1.0 : std::sin(kPi * cutoff * x) / (kPi * cutoff * x);
+                double n = (x + taps_ / 2) / taps_;
+                double window = 0.42 - 0.5 * std::cos(2 * kPi * n) + 0.08 * std::cos(4 * kPi * n);
+                taps[i] = sinc * window;
+            }
+            total += taps[i];
+        }
+        for(int i = 0; i < taps_; ++i)
+            taps[i] /= total;
+    }
+    table_.assign(kPhases * 2 * taps_, 0.0f);
+    for(int phase = 0; phase < kPhases; ++phase) {
+        float* row = &table_[phase * 2 * taps_];
+        for(int i = 0; i < taps_; ++i) {
+            row[i] = (float) rows[phase * taps_ + i];
+            row[taps_ + i] = (float) (rows[(phase + 1) * taps_ + i] - rows[phase * taps_ + i]);
+        }
+    }
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ozones {
+
+// Polyphase windowed-sinc resampler for mono audio. Each output sample is a
+// dot product of the input history with the filter phase nearest its
+// position, linearly interpolated towards the next phase.
+class Resampler {
+public:
+    enum Quality {
+        // Plain linear interpolation, for fast-forward
+        kLinear,
+        kNormal,
+        kHigh
+    };
+    // Dot product implementations, fastest last
+    enum Kernel {
+        kScalar,
+        kSse,
+        kAvx2
+    };
+    Resampler(double input_rate, double output_rate, Quality quality = kNormal);
+    // Redesigns the filter for the new rates
+    void SetRates(double input_rate, double output_rate);
+    // Scales the output rate by factor without redesigning the filter, for rate control
+    void SetRateAdjustment(double factor);
+    void SetQuality(Quality quality);
+    Quality GetQuality();
+    // Caps the kernel, e.g. to compare them; by default the fastest one is used
+    void SetMaxKernel(Kernel kernel);
+    // The fastest kernel the cap, the CPU and the tap count allow
+    Kernel GetKernel();
+    // Appends the output for count more input samples to out
+    void Process(const int16_t* in, size_t count, std::vector<int16_t>& out);
+    void Reset();
+private:
+    static const int kPhaseBits = 7;
+    static const int kPhases = 1 << kPhaseBits;
+    static const int kTimeBits = 32;
+    void BuildTable();
+    void UpdateStep();
+    double input_rate_;
+    double output_rate_;
+    double adjustment_;
+    Quality quality_;
+    Kernel max_kernel_;
+    int taps_;
+    // Input samples per output sample in 32.32 fixed point
+    uint64_t step_;
+    // Position of the next output sample in history_, 32.32 fixed point
+    uint64_t position_;
+    // kPhases rows, each taps_ coefficients followed by their
+    // difference to the next phase's
+    std::vector<float> table_;
+    std::vector<float> history_;
+};
+
+}
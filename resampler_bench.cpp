@@ -0,0 +1,114 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "resampler.h"
+
+using namespace ozones;
+
+namespace {
+
+const double kInputRate = 96000.0;
+const double kOutputRate = 48000.0;
+// Input handed to Process at a time, one NTSC frame's worth
+const size_t kChunk = 1600;
+// Kernels sum in a different order, which may move a sample across a rounding boundary
+const int kTolerance = 1;
+
+// A square wave like the pulse channels make, a tone above the output Nyquist
+// frequency and some noise, so every tap contributes
+std::vector<int16_t> BuildInput(double seconds) {
+    const double kPi = 3.14159265358979323846;
+    std::vector<int16_t> input((size_t) (seconds * kInputRate));
+    uint32_t noise = 1;
+    for(size_t i = 0; i < input.size(); ++i) {
+        noise = noise * 1664525 + 1013904223;
+        double square = (i / 109) % 2 ? 6000.0 : -6000.0;
+        double tone = 4000.0 * std::sin(2.0 * kPi * 30000.0 * i / kInputRate);
+        input[i] = (int16_t) (square + tone + (int) (noise >> 22) - 512);
+    }
+    return input;
+}
+
+std::vector<int16_t> Resample(const std::vector<int16_t>& input, Resampler::Quality quality, Resampler::Kernel kernel, double& seconds) {
+    Resampler resampler(kInputRate, kOutputRate, quality);
+    resampler.SetMaxKernel(kernel);
+    std::vector<int16_t> output;
+    output.reserve((size_t) (input.size() * kOutputRate / kInputRate) + kChunk);
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < input.size(); i += kChunk)
+        resampler.Process(&input[i], std::min(kChunk, input.size() - i), output);
+    seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return output;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    // ozones-resampler-bench [--seconds N] [--runs N]
+    // Times every quality level with every kernel the CPU has, keeping the
+    // best of the runs, and fails if a vector kernel strays from the scalar one
+    double seconds = 10.0;
+    int runs = 5;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--seconds" && i + 1 < argc) {
+            seconds = std::atof(argv[++i]);
+        } else if(arg == "--runs" && i + 1 < argc) {
+            runs = std::max(1, std::atoi(argv[++i]));
+        } else {
+            std::cerr << "Usage: " << argv[0] << " [--seconds N] [--runs N]" << std::endl;
+            return EXIT_FAILURE;
+        }
+    }
+    std::vector<int16_t> input = BuildInput(seconds);
+    const std::pair<Resampler::Quality, const char*> kQualities[] = {
+        { Resampler::kLinear, "linear" },
+        { Resampler::kNormal, "normal" },
+        { Resampler::kHigh, "high" }
+    };
+    const std::pair<Resampler::Kernel, const char*> kKernels[] = {
+        { Resampler::kScalar, "scalar" },
+        { Resampler::kSse, "SSE" },
+        { Resampler::kAvx2, "AVX2" }
+    };
+    std::cout << "Resampling " << seconds << " s from " << kInputRate << " Hz to " << kOutputRate << " Hz" << std::endl;
+    bool passed = true;
+    for(auto& quality : kQualities) {
+        std::vector<int16_t> reference;
+        for(auto& kernel : kKernels) {
+            // Skip kernels that would fall back to a slower one
+            Resampler probe(kInputRate, kOutputRate, quality.first);
+            probe.SetMaxKernel(kernel.first);
+            if(probe.GetKernel() != kernel.first)
+                continue;
+            double best = 0.0;
+            std::vector<int16_t> output;
+            for(int run = 0; run < runs; ++run) {
+                double elapsed;
+                output = Resample(input, quality.first, kernel.first, elapsed);
+                best = run == 0 ? elapsed : std::min(best, elapsed);
+            }
+            if(kernel.first == Resampler::kScalar)
+                reference = output;
+            int difference = output.size() == reference.size() ? 0 : 65536;
+            for(size_t i = 0; i < std::min(output.size(), reference.size()); ++i)
+                difference = std::max(difference, std::abs(output[i] - reference[i]));
+            std::cout << quality.second << " " << kernel.second << ": " << best * 1000.0 << " ms, "
+                      << output.size() << " samples, largest difference from scalar " << difference << std::endl;
+            if(difference > kTolerance) {
+                std::cout << quality.second << " " << kernel.second << " differs from scalar by more than " << kTolerance << std::endl;
+                passed = false;
+            }
+        }
+    }
+    return passed ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,82 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "rewind_buffer.h"
+#include <algorithm>
+#include "run_length.h"
+
+namespace ozones {
+
+RewindBuffer::RewindBuffer(size_t capacity, int keyframe_interval) : storage_(capacity), head_(0), keyframe_interval_(keyframe_interval), since_keyframe_(0) { }
+
+void RewindBuffer::Push(const std::vector<uint8_t>& state) {
+    if(current_.size() == state.size()) {
+        scratch_.clear();
+        bool keyframe = ++since_keyframe_ >= keyframe_interval_;
+        RunLength::EncodeXor(current_.data(), keyframe ? nullptr : state.data(), current_.size(), scratch_);
+        if(keyframe)
+            since_keyframe_ = 0;
+        if(scratch_.size() <= storage_.size()) {
+            size_t offset = Allocate(scratch_.size());
+            std::copy(scratch_.begin(), scratch_.end(), storage_.begin() + offset);
+            entries_.push_back({ offset, scratch_.size(), keyframe });
+        } else {
+            entries_.clear();
+        }
+    } else {
+        // A differently sized state can't be chained to the old history
+        Clear();
+    }
+    current_ = state;
+}
+
+bool RewindBuffer::Pop(std::vector<uint8_t>& state) {
+    if(entries_.empty())
+        return false;
+    Entry entry = entries_.back();
+    entries_.pop_back();
+    head_ = entry.offset;
+    if(entry.keyframe)
+        std::fill(current_.begin(), current_.end(), 0);
+    if(!RunLength::DecodeXor(&storage_[entry.offset], entry.size, current_.data(), current_.size())) {
+        Clear();
+        return false;
+    }
+    state = current_;
+    return true;
+}
+
+size_t RewindBuffer::GetFrameCount() {
+    return entries_.size();
+}
+
+size_t RewindBuffer::GetUsedBytes() {
+    size_t used = 0;
+    for(auto& entry : entries_)
+        used += entry.size;
+    return used;
+}
+
+void RewindBuffer::Clear() {
+    entries_.clear();
+    current_.clear();
+    head_ = 0;
+    since_keyframe_ = 0;
+}
+
+// Entries sit in the ring in push order, so the oldest ones are those just past the head
+size_t RewindBuffer::Allocate(size_t size) {
+    size_t offset = head_;
+    if(offset + size > storage_.size()) {
+        // Wrapping skips the tail of the ring, which holds the oldest entries
+        while(!entries_.empty() && entries_.front().offset >= head_)
+            entries_.pop_front();
+        offset = 0;
+    }
+    while(!entries_.empty() && entries_.front().offset >= offset && entries_.front().offset < offset + size)
+        entries_.pop_front();
+    head_ = offset + size;
+    return offset;
+}
+
+}
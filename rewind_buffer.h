@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace ozones {
+
+// Bounded history of machine states for stepping backwards. Only the newest
+// state is kept whole; each older one is stored run-length coded as its XOR
+// against the state after it, or every keyframe_interval entries coded on
+// its own, so one corrupt or dropped entry can't take all history with it.
+// The oldest entries are evicted to stay within the memory budget.
+class RewindBuffer {
+public:
+    RewindBuffer(size_t capacity, int keyframe_interval = 60);
+    // Records the state after the latest frame
+    void Push(const std::vector<uint8_t>& state);
+    // Steps back one recorded frame, returning false when the history is exhausted
+    bool Pop(std::vector<uint8_t>& state);
+    size_t GetFrameCount();
+    // Bytes of encoded history in the ring
+    size_t GetUsedBytes();
+    void Clear();
+private:
+    struct Entry {
+        size_t offset;
+        size_t size;
+        bool keyframe;
+    };
+    // Returns the ring offset for size bytes, evicting the oldest entries in the way
+    size_t Allocate(size_t size);
+    std::vector<uint8_t> storage_;
+    std::deque<Entry> entries_;
+    size_t head_;
+    int keyframe_interval_;
+    int since_keyframe_;
+    std::vector<uint8_t> current_;
+    std::vector<uint8_t> scratch_;
+};
+
+}
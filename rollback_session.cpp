@@ -0,0 +1,168 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "rollback_session.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace ozones {
+
+RollbackSession::RollbackSession(Machine& machine, NetplayTransport& transport, unsigned local_port,
+                                 unsigned input_delay, unsigned max_rollback) : machine_(machine),
+        transport_(transport), local_(local_port), remote_(1 - local_port), max_rollback_(max_rollback),
+        inputs_(), frame_(0), local_end_(input_delay), remote_end_(0),
+        rollback_from_(std::numeric_limits<uint64_t>::max()), peer_ack_(0), peer_frame_(0),
+        peer_advantage_(0), last_sync_stall_(0), rollback_budget_(0.004), snapshots_(max_rollback), snapshot_epochs_(max_rollback),
+        stats_() {
+    // Unacknowledged local inputs, at most 2 * (max_rollback + input_delay)
+    // when one direction is down, must all fit into the history to be resent
+    if(local_port > 1 || input_delay > 8 || max_rollback == 0 || max_rollback > 32 ||
+       2 * (max_rollback + input_delay) > kHistory)
+        throw std::runtime_error("Invalid netplay settings");
+}
+
+bool RollbackSession::AdvanceFrame(uint8_t buttons, Ppu::RenderMode mode) {
+    ReceivePackets();
+    Rollback();
+    bool wait = frame_ >= remote_end_ + max_rollback_;
+    // The peer sees this machine's frames a one-way trip late and vice versa, so
+    // comparing both views cancels the latency out; wait a frame when ahead
+    int advantage = (int) ((int64_t) frame_ - (int64_t) peer_frame_);
+    if(!wait && advantage - peer_advantage_ >= 2 && frame_ - last_sync_stall_ >= kSyncInterval) {
+        wait = true;
+        last_sync_stall_ = frame_;
+    }
+    if(wait) {
+        ++stats_.stalls;
+    } else {
+        inputs_[local_][local_end_ % kHistory] = buttons;
+        ++local_end_;
+        RunFrame(mode, true);
+    }
+    SendPacket();
+    return !wait;
+}
+
+void RollbackSession::Synchronize() {
+    ReceivePackets();
+    Rollback();
+    SendPacket();
+}
+
+void RollbackSession::SetRollbackBudget(double seconds) {
+    rollback_budget_ = seconds;
+}
+
+uint64_t RollbackSession::GetFrame() {
+    return frame_;
+}
+
+uint64_t RollbackSession::GetConfirmedFrame() {
+    return std::min(remote_end_, frame_);
+}
+
+RollbackSession::Stats RollbackSession::GetStats() {
+    return stats_;
+}
+
+void RollbackSession::ReceivePackets() {
+    while(transport_.Receive(packet_)) {
+        Packet header;
+        if(packet_.size() < sizeof(header))
+            continue;
+        std::memcpy(&header, packet_.data(), sizeof(header));
+        if(header.magic != Packet::kMagic || packet_.size() != sizeof(header) + header.count)
+            continue;
+        if(header.rom_hash != machine_.GetRomHash())
+            throw std::runtime_error("The netplay peer is running another ROM");
+        peer_ack_ = std::max(peer_ack_, (uint64_t) header.ack);
+        if(header.frame >= peer_frame_) {
+            peer_frame_ = header.frame;
+            peer_advantage_ = header.advantage;
+        }
+        // Inputs are resent until acknowledged, so anything past a gap comes again later
+        const uint8_t* inputs = packet_.data() + sizeof(header);
+        for(uint64_t frame = header.first_frame; frame < (uint64_t) header.first_frame + header.count; ++frame) {
+            if(frame > remote_end_)
+                break;
+            if(frame < remote_end_)
+                continue;
+            uint8_t& input = inputs_[remote_][frame % kHistory];
+            uint8_t actual = inputs[frame - header.first_frame];
+            if(frame < frame_ && input != actual)
+                rollback_from_ = std::min(rollback_from_, frame);
+            input = actual;
+            ++remote_end_;
+        }
+    }
+}
+
+void RollbackSession::SendPacket() {
+    // Everything the peer hasn't acknowledged; inputs skipped here would never arrive
+    uint64_t first = std::min(peer_ack_, local_end_);
+    Packet header = {};
+    header.magic = Packet::kMagic;
+    header.ack = (uint32_t) remote_end_;
+    header.frame = (uint32_t) frame_;
+    header.first_frame = (uint32_t) first;
+    header.rom_hash = machine_.GetRomHash();
+    header.advantage = (int16_t) std::max(std::min((int64_t) frame_ - (int64_t) peer_frame_, (int64_t) INT16_MAX),
+                                          (int64_t) INT16_MIN);
+    header.count = (uint16_t) (local_end_ - first);
+    packet_.resize(sizeof(header) + header.count);
+    std::memcpy(packet_.data(), &header, sizeof(header));
+    for(uint64_t frame = first; frame < local_end_; ++frame)
+        packet_[sizeof(header) + frame - first] = inputs_[local_][frame % kHistory];
+    transport_.Send(packet_.data(), packet_.size());
+}
+
+void RollbackSession::Rollback() {
+    if(rollback_from_ >= frame_) {
+        rollback_from_ = std::numeric_limits<uint64_t>::max();
+        return;
+    }
+    auto start = std::chrono::steady_clock::now();
+    uint64_t end = frame_;
+    size_t slot = rollback_from_ % max_rollback_;
+    snapshot_epochs_[slot] = machine_.RestoreState(snapshots_[slot], snapshot_epochs_[slot]);
+    frame_ = rollback_from_;
+    // The mispredicted frames were already heard
+    bool muted = machine_.GetBlipBuffer()->IsMuted();
+    machine_.SetAudioEnabled(false);
+    while(frame_ < end)
+        RunFrame(Ppu::kRenderTimingOnly, false);
+    machine_.SetAudioEnabled(!muted);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    unsigned frames = (unsigned) (end - rollback_from_);
+    ++stats_.rollbacks;
+    stats_.resimulated_frames += frames;
+    stats_.max_rollback_frames = std::max(stats_.max_rollback_frames, frames);
+    stats_.max_rollback_seconds = std::max(stats_.max_rollback_seconds, seconds);
+    stats_.total_rollback_seconds += seconds;
+    if(seconds > rollback_budget_)
+        ++stats_.rollbacks_over_budget;
+    rollback_from_ = std::numeric_limits<uint64_t>::max();
+}
+
+void RollbackSession::RunFrame(Ppu::RenderMode mode, bool first_run) {
+    uint8_t& remote = inputs_[remote_][frame_ % kHistory];
+    if(frame_ >= remote_end_) {
+        // Only frames run on a prediction can need returning to
+        remote = remote_end_ > 0 ? inputs_[remote_][(remote_end_ - 1) % kHistory] : 0;
+        size_t slot = frame_ % max_rollback_;
+        snapshot_epochs_[slot] = machine_.SaveState(snapshots_[slot]);
+        if(first_run)
+            ++stats_.predicted_frames;
+    }
+    machine_.SetButtons(local_, inputs_[local_][frame_ % kHistory]);
+    machine_.SetButtons(remote_, remote);
+    machine_.RunFrame(mode);
+    ++frame_;
+    if(first_run)
+        ++stats_.frames;
+}
+
+}
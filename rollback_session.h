@@ -0,0 +1,95 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "machine.h"
+#include "netplay_transport.h"
+
+namespace ozones {
+
+// Two-player netplay by rollback. Each peer runs the whole game and only
+// exchanges inputs; frames run ahead on a prediction of the remote input
+// (its last known value), and when the real input arrives and differs the
+// machine returns to the snapshot before the first wrong frame and runs
+// forward again, all within the host frame that received it.
+class RollbackSession {
+public:
+    // Local input is applied input_delay frames late, trading a little lag
+    // for fewer rollbacks. No frame runs more than max_rollback frames past
+    // the last confirmed remote input.
+    RollbackSession(Machine& machine, NetplayTransport& transport, unsigned local_port,
+                    unsigned input_delay = 1, unsigned max_rollback = 8);
+    // One host frame: takes the local input, rolls back for any mispredicted
+    // remote input received, then runs the next frame. Returns false if it had
+    // to wait for the peer instead, in which case buttons is dropped.
+    bool AdvanceFrame(uint8_t buttons, Ppu::RenderMode mode = Ppu::kRenderFull);
+    // Exchanges inputs and rolls back like AdvanceFrame, without running a new frame
+    void Synchronize();
+    // Rollbacks taking longer than this are counted in the stats; a quarter of a frame by default
+    void SetRollbackBudget(double seconds);
+    // The next frame to run
+    uint64_t GetFrame();
+    // Frames before this one ran on the real inputs of both players
+    uint64_t GetConfirmedFrame();
+    struct Stats {
+        uint64_t frames;
+        // Frames first run on a predicted remote input
+        uint64_t predicted_frames;
+        uint64_t rollbacks;
+        uint64_t resimulated_frames;
+        // Host frames spent waiting for the peer, to stay within max_rollback or in step with it
+        uint64_t stalls;
+        // Restore plus re-run, the part that must fit into a host frame
+        double max_rollback_seconds;
+        double total_rollback_seconds;
+        unsigned max_rollback_frames;
+        uint64_t rollbacks_over_budget;
+    };
+    Stats GetStats();
+private:
+    struct Packet {
+        static const uint32_t kMagic = 0x504E5A4F; // "OZNP"
+        uint32_t magic;
+        // Remote inputs received without gaps, i.e. the first one the sender still needs
+        uint32_t ack;
+        uint32_t frame;
+        // Of the inputs that follow the header
+        uint32_t first_frame;
+        uint64_t rom_hash;
+        // Sender's frame minus the last frame it heard the receiver was at
+        int16_t advantage;
+        uint16_t count;
+        uint32_t reserved;
+    };
+    // Inputs and predictions kept per player
+    static const size_t kHistory = 128;
+    // Frames between corrections for running ahead of the peer
+    static const uint64_t kSyncInterval = 10;
+    void ReceivePackets();
+    void SendPacket();
+    void Rollback();
+    void RunFrame(Ppu::RenderMode mode, bool first_run);
+    Machine& machine_;
+    NetplayTransport& transport_;
+    unsigned local_, remote_;
+    unsigned max_rollback_;
+    std::array<std::array<uint8_t, kHistory>, 2> inputs_;
+    // Local inputs are known up to local_end_, remote ones without gaps up to remote_end_
+    uint64_t frame_, local_end_, remote_end_;
+    // Earliest frame run on a prediction that turned out wrong
+    uint64_t rollback_from_;
+    // What the peer last reported
+    uint64_t peer_ack_, peer_frame_;
+    int peer_advantage_;
+    uint64_t last_sync_stall_;
+    double rollback_budget_;
+    // The state before each of the last max_rollback frames that ran on a prediction
+    std::vector<std::vector<uint8_t>> snapshots_;
+    std::vector<uint32_t> snapshot_epochs_;
+    std::vector<uint8_t> packet_;
+    Stats stats_;
+};
+
+}
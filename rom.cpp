@@ -16,6 +16,8 @@ Rom::Rom(std::istream &stream, size_t size) : size_(size), contents_(size) {
     }
 }
 
+Rom::Rom(std::vector<uint8_t> contents) : size_(contents.size()), contents_(std::move(contents)) { }
+
 uint8_t Rom::ReadByte(size_t addr) {
     return contents_[addr % size_];
 }
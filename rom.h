@@ -10,6 +10,7 @@ namespace ozones {
 class Rom : public Mappable {
 public:
     Rom(std::istream& stream, size_t size);
+    Rom(std::vector<uint8_t> contents);
     uint8_t ReadByte(size_t addr) override;
     void WriteByte(size_t addr, uint8_t value) override;
 private:
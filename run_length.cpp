@@ -0,0 +1,107 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "run_length.h"
+#include <algorithm>
+#include <cstring>
+
+namespace ozones {
+
+void RunLength::EncodeXor(const uint8_t* data, const uint8_t* reference, size_t size, std::vector<uint8_t>& out) {
+    auto at = [=](size_t i) -> uint8_t {
+        return reference ? data[i] ^ reference[i] : data[i];
+    };
+    size_t literal_start = 0;
+    size_t i = 0;
+    while(i < size) {
+        uint8_t value = at(i);
+        size_t run_end = i + 1;
+        // Zero runs dominate deltas, compare them a word at a time
+        if(value == 0 && reference) {
+            while(run_end + 8 <= size) {
+                uint64_t a, b;
+                std::memcpy(&a, data + run_end, 8);
+                std::memcpy(&b, reference + run_end, 8);
+                if(a != b)
+                    break;
+                run_end += 8;
+            }
+        }
+        while(run_end < size && at(run_end) == value)
+            ++run_end;
+        if(run_end - i < kMinRun) {
+            i = run_end;
+            continue;
+        }
+        if(i > literal_start) {
+            WriteToken(i - literal_start, 0, out);
+            for(size_t j = literal_start; j < i; ++j)
+                out.push_back(at(j));
+        }
+        WriteToken(run_end - i - kMinRun, 1, out);
+        out.push_back(value);
+        i = literal_start = run_end;
+    }
+    if(size > literal_start) {
+        WriteToken(size - literal_start, 0, out);
+        for(size_t j = literal_start; j < size; ++j)
+            out.push_back(at(j));
+    }
+}
+
+bool RunLength::DecodeXor(const uint8_t* in, size_t in_size, uint8_t* out, size_t size) {
+    const uint8_t* end = in + in_size;
+    size_t position = 0;
+    while(in < end) {
+        size_t length;
+        int type;
+        if(!ReadToken(in, end, length, type))
+            return false;
+        if(type == 0) {
+            if(length > size - position || length > (size_t) (end - in))
+                return false;
+            for(size_t i = 0; i < length; ++i)
+                out[position + i] ^= in[i];
+            in += length;
+        } else {
+            length += kMinRun;
+            if(length > size - position || in == end)
+                return false;
+            uint8_t value = *in++;
+            // A zero run leaves the reference as it is
+            if(value) {
+                for(size_t i = 0; i < length; ++i)
+                    out[position + i] ^= value;
+            }
+        }
+        position += length;
+    }
+    return position == size;
+}
+
+void RunLength::WriteToken(size_t length, int type, std::vector<uint8_t>& out) {
+    uint64_t token = ((uint64_t) length << 1) | type;
+    while(token >= 0x80) {
+        out.push_back((uint8_t) (token | 0x80));
+        token >>= 7;
+    }
+    out.push_back((uint8_t) token);
+}
+
+bool RunLength::ReadToken(const uint8_t*& in, const uint8_t* end, size_t& length, int& type) {
+    uint64_t token = 0;
+    for(int shift = 0; shift < 64; shift += 7) {
+        if(in == end)
+            return false;
+        uint8_t byte = *in++;
+        token |= (uint64_t) (byte & 0x7F) << shift;
+        if(!(byte & 0x80)) {
+            length = token >> 1;
+            type = token & 1;
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ozones {
+
+// Byte-oriented run-length coding tuned for snapshot deltas, which are
+// mostly zero. The stream is a sequence of LEB128 tokens (length << 1 | type):
+// type 0 is followed by length literal bytes, type 1 by one byte repeated
+// length + kMinRun times.
+class RunLength {
+public:
+    // Appends the encoding of data XOR reference to out; a null reference encodes data itself
+    static void EncodeXor(const uint8_t* data, const uint8_t* reference, size_t size, std::vector<uint8_t>& out);
+    // XORs the decoded bytes into out, which must be exactly the encoded size;
+    // returns false if the stream is malformed
+    static bool DecodeXor(const uint8_t* in, size_t in_size, uint8_t* out, size_t size);
+private:
+    static const size_t kMinRun = 4;
+    static void WriteToken(size_t length, int type, std::vector<uint8_t>& out);
+    static bool ReadToken(const uint8_t*& in, const uint8_t* end, size_t& length, int& type);
+};
+
+}
@@ -0,0 +1,269 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include <cerrno>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "machine_pool.h"
+#include "step_protocol.h"
+
+using namespace ozones;
+
+static_assert(kObservationWidth == Ppu::kScreenWidth && kObservationHeight == Ppu::kScreenHeight,
+              "Observations hold a whole frame");
+
+namespace {
+
+std::runtime_error SystemError(const std::string& what) {
+    return std::runtime_error(what + ": " + std::strerror(errno));
+}
+
+// One client's machine, its snapshots and the observation ring shared with it; the socket stays the caller's
+class Session {
+public:
+    Session(int socket, MachinePool& pool);
+    ~Session();
+    // Serves batches until the client disconnects
+    void Run();
+private:
+    struct Snapshot {
+        std::vector<uint8_t> state;
+        uint32_t epoch;
+        uint64_t frame;
+    };
+    void SendHello();
+    StepReply RunBatch(const StepCommand* commands, size_t count);
+    void RunCommand(const StepCommand& command, Observation& observation);
+    int socket_;
+    MachinePool& pool_;
+    std::unique_ptr<Machine> machine_;
+    int memory_fd_;
+    Observation* observations_;
+    uint32_t batch_;
+    uint64_t frame_;
+    std::vector<Snapshot> snapshots_;
+};
+
+Session::Session(int socket, MachinePool& pool) : socket_(socket), pool_(pool), machine_(pool.Acquire()),
+                                                  batch_(0), frame_(0) {
+    memory_fd_ = memfd_create("ozones-observations", MFD_CLOEXEC);
+    if(memory_fd_ < 0)
+        throw SystemError("memfd_create");
+    size_t size = sizeof(Observation) * kObservationSlots;
+    if(ftruncate(memory_fd_, (off_t) size) != 0) {
+        close(memory_fd_);
+        throw SystemError("ftruncate");
+    }
+    void* memory = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd_, 0);
+    if(memory == MAP_FAILED) {
+        close(memory_fd_);
+        throw SystemError("mmap");
+    }
+    observations_ = (Observation*) memory;
+}
+
+Session::~Session() {
+    munmap(observations_, sizeof(Observation) * kObservationSlots);
+    close(memory_fd_);
+    pool_.Release(std::move(machine_));
+}
+
+void Session::Run() {
+    SendHello();
+    StepCommand commands[kMaxBatchCommands];
+    for(;;) {
+        // MSG_TRUNC returns the whole message's length, so an oversized batch
+        // is refused instead of silently losing its tail
+        ssize_t received = recv(socket_, commands, sizeof(commands), MSG_TRUNC);
+        if(received <= 0)
+            return;
+        StepReply reply;
+        if((size_t) received > sizeof(commands) || received % sizeof(StepCommand) != 0) {
+            reply = {};
+            reply.failed = 1;
+            reply.frame = frame_;
+        } else {
+            reply = RunBatch(commands, (size_t) received / sizeof(StepCommand));
+        }
+        if(send(socket_, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply))
+            return;
+    }
+}
+
+void Session::SendHello() {
+    StepHello hello = {};
+    hello.magic = kStepMagic;
+    hello.version = kStepVersion;
+    hello.slots = kObservationSlots;
+    hello.slot_size = sizeof(Observation);
+    hello.rom_hash = machine_->GetRomHash();
+    iovec data = { &hello, sizeof(hello) };
+    alignas(cmsghdr) char control[CMSG_SPACE(sizeof(int))] = {};
+    msghdr message = {};
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+    cmsghdr* rights = CMSG_FIRSTHDR(&message);
+    rights->cmsg_level = SOL_SOCKET;
+    rights->cmsg_type = SCM_RIGHTS;
+    rights->cmsg_len = CMSG_LEN(sizeof(int));
+    std::memcpy(CMSG_DATA(rights), &memory_fd_, sizeof(int));
+    if(sendmsg(socket_, &message, MSG_NOSIGNAL) != sizeof(hello))
+        throw SystemError("sendmsg");
+}
+
+StepReply Session::RunBatch(const StepCommand* commands, size_t count) {
+    StepReply reply = {};
+    reply.slot = batch_ % kObservationSlots;
+    Observation& observation = observations_[reply.slot];
+    observation.has_frame = 0;
+    for(size_t i = 0; i < count; ++i) {
+        try {
+            RunCommand(commands[i], observation);
+        } catch(std::runtime_error&) {
+            reply.failed = (uint32_t) i + 1;
+            break;
+        }
+    }
+    observation.frame = frame_;
+    observation.batch = batch_++;
+    reply.frame = frame_;
+    return reply;
+}
+
+void Session::RunCommand(const StepCommand& command, Observation& observation) {
+    switch(command.op) {
+    case kStepFrames:
+        machine_->SetButtons(0, command.input & 0xFF);
+        machine_->SetButtons(1, command.input >> 8);
+        for(uint32_t i = 0; i < command.count; ++i) {
+            bool draw = command.render && i + 1 == command.count;
+            machine_->RunFrame(draw ? Ppu::kRenderFull : Ppu::kRenderTimingOnly);
+            ++frame_;
+        }
+        if(command.render && command.count != 0) {
+            std::memcpy(observation.framebuffer, machine_->GetFramebuffer(), sizeof(observation.framebuffer));
+            observation.has_frame = 1;
+        }
+        break;
+    case kStepSnapshot: {
+        if(command.index >= kMaxSnapshots)
+            throw std::runtime_error("Snapshot index out of range");
+        if(command.index >= snapshots_.size())
+            snapshots_.resize(command.index + 1);
+        Snapshot& snapshot = snapshots_[command.index];
+        snapshot.epoch = machine_->SaveState(snapshot.state);
+        snapshot.frame = frame_;
+        break;
+    }
+    case kStepRestore: {
+        if(command.index >= snapshots_.size() || snapshots_[command.index].state.empty())
+            throw std::runtime_error("No such snapshot");
+        // Only the pages written since the snapshot are copied back
+        Snapshot& snapshot = snapshots_[command.index];
+        snapshot.epoch = machine_->RestoreState(snapshot.state, snapshot.epoch);
+        frame_ = snapshot.frame;
+        break;
+    }
+    case kStepReadRam:
+        if(command.index > kObservationRamSize || command.count > kObservationRamSize - command.index)
+            throw std::runtime_error("RAM range out of bounds");
+        std::memcpy(observation.ram + command.index, machine_->GetRam() + command.index, command.count);
+        break;
+    case kStepHardReset:
+        machine_->HardReset();
+        frame_ = 0;
+        break;
+    case kStepSoftReset:
+        machine_->SoftReset();
+        break;
+    default:
+        throw std::runtime_error("Unknown command");
+    }
+}
+
+int Listen(const std::string& path) {
+    sockaddr_un address = {};
+    address.sun_family = AF_UNIX;
+    if(path.size() >= sizeof(address.sun_path))
+        throw std::runtime_error("Socket path too long: " + path);
+    std::strcpy(address.sun_path, path.c_str());
+    int listener = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if(listener < 0)
+        throw SystemError("socket");
+    unlink(path.c_str());
+    if(bind(listener, (sockaddr*) &address, sizeof(address)) != 0 || listen(listener, 16) != 0) {
+        close(listener);
+        throw SystemError("Cannot listen on " + path);
+    }
+    return listener;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    // ozones-server [--socket path] [--preallocate N] rom
+    std::string socket_path = "ozones.sock";
+    size_t preallocate = 0;
+    std::string rom_path;
+    for(int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if(arg == "--socket" && i + 1 < argc)
+            socket_path = argv[++i];
+        else if(arg == "--preallocate" && i + 1 < argc)
+            preallocate = (size_t) std::atoi(argv[++i]);
+        else
+            rom_path = arg;
+    }
+    if(rom_path.empty()) {
+        std::cerr << "Usage: " << argv[0] << " [--socket path] [--preallocate N] rom" << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::ifstream rom(rom_path, std::ios::in | std::ios::binary);
+    if(!rom) {
+        std::cerr << "Cannot open " << rom_path << std::endl;
+        return EXIT_FAILURE;
+    }
+    std::unique_ptr<MachinePool> pool;
+    int listener;
+    try {
+        pool = std::make_unique<MachinePool>(rom, preallocate);
+        listener = Listen(socket_path);
+    } catch(std::runtime_error& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+    // Each client gets its own thread and machine; the emulator is the only work between round trips
+    for(;;) {
+        int client = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+        if(client < 0) {
+            if(errno == EINTR || errno == ECONNABORTED)
+                continue;
+            std::cerr << SystemError("accept").what() << std::endl;
+            return EXIT_FAILURE;
+        }
+        std::thread([client, &pool]() {
+            try {
+                Session session(client, *pool);
+                session.Run();
+            } catch(std::runtime_error& e) {
+                std::cerr << e.what() << std::endl;
+            }
+            close(client);
+        }).detach();
+    }
+}
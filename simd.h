@@ -0,0 +1,26 @@
+#pragma once
+
+namespace ozones {
+
+// Runtime CPU feature checks for the hand-vectorised paths, which are
+// compiled with per-function target attributes
+inline bool& Avx2Enabled() {
+    static bool enabled = true;
+    return enabled;
+}
+
+inline bool HasAvx2() {
+    static const bool has_avx2 = [] {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2");
+    }();
+    return has_avx2 && Avx2Enabled();
+}
+
+// Disabled, the AVX2 paths fall back to their scalar versions, so checks can
+// compare the two; not meant to be switched while other threads are running
+inline void SetAvx2Enabled(bool enabled) {
+    Avx2Enabled() = enabled;
+}
+
+}
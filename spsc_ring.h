@@ -0,0 +1,60 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <vector>
+
+namespace ozones {
+
+// Lock-free single-producer/single-consumer FIFO. Both sides copy as much as
+// fits or is available and return at once, so neither ever waits for the other.
+template<typename T>
+class SpscRing {
+public:
+    // Capacity is rounded up to a power of two
+    explicit SpscRing(size_t capacity) : buffer_(RoundUp(capacity)), mask_(buffer_.size() - 1), head_(0), tail_(0) { }
+    size_t GetCapacity() {
+        return buffer_.size();
+    }
+    // Number of queued elements; exact from either side, a lower or upper bound from the other
+    size_t GetSize() {
+        return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+    }
+    // Producer side, returns the number of elements written
+    size_t Write(const T* data, size_t count) {
+        size_t head = head_.load(std::memory_order_relaxed);
+        size_t tail = tail_.load(std::memory_order_acquire);
+        count = std::min(count, buffer_.size() - (head - tail));
+        size_t first = std::min(count, buffer_.size() - (head & mask_));
+        std::copy_n(data, first, &buffer_[head & mask_]);
+        std::copy_n(data + first, count - first, &buffer_[0]);
+        head_.store(head + count, std::memory_order_release);
+        return count;
+    }
+    // Consumer side, returns the number of elements read
+    size_t Read(T* data, size_t count) {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        size_t head = head_.load(std::memory_order_acquire);
+        count = std::min(count, head - tail);
+        size_t first = std::min(count, buffer_.size() - (tail & mask_));
+        std::copy_n(&buffer_[tail & mask_], first, data);
+        std::copy_n(&buffer_[0], count - first, data + first);
+        tail_.store(tail + count, std::memory_order_release);
+        return count;
+    }
+private:
+    static size_t RoundUp(size_t capacity) {
+        size_t size = 1;
+        while(size < capacity)
+            size <<= 1;
+        return size;
+    }
+    std::vector<T> buffer_;
+    size_t mask_;
+    // Free-running counters, kept on separate cache lines so the two sides don't contend
+    alignas(64) std::atomic<size_t> head_;
+    alignas(64) std::atomic<size_t> tail_;
+};
+
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+namespace ozones {
+
+// FNV-1a, identifying cartridges and comparing states
+inline uint64_t HashBytes(uint64_t hash, const uint8_t* data, size_t size) {
+    for(size_t i = 0; i < size; ++i)
+        hash = (hash ^ data[i]) * 0x100000001B3;
+    return hash;
+}
+
+const uint64_t kHashBasis = 0xCBF29CE484222325;
+
+// Prefix of a serialized machine state. The state is host-endian raw field
+// data, so the version must change whenever any component's layout does.
+struct StateHeader {
+    static const uint32_t kMagic = 0x54535A4F; // "OZST"
+    // Incremental snapshot holding only the memory pages written since an earlier one
+    static const uint32_t kDeltaMagic = 0x44535A4F; // "OZSD"
+    static const uint32_t kVersion = 2;
+    uint32_t magic;
+    uint32_t version;
+    // Identifies the cartridge the state belongs to
+    uint64_t rom_hash;
+    // Bytes of state following the header
+    uint64_t size;
+};
+
+// Appends raw copies of fields to a flat snapshot buffer. With a null
+// buffer it only counts, so a component's state size is measured by
+// saving it once.
+class StateWriter {
+public:
+    explicit StateWriter(uint8_t* out) : out_(out), size_(0) { }
+    template<typename T>
+    void Write(const T& value) {
+        Write(&value, sizeof(T));
+    }
+    void Write(const void* data, size_t size) {
+        if(out_) {
+            std::memcpy(out_, data, size);
+            out_ += size;
+        }
+        size_ += size;
+    }
+    size_t GetSize() {
+        return size_;
+    }
+private:
+    uint8_t* out_;
+    size_t size_;
+};
+
+// Reads fields back in the order a StateWriter wrote them. Given the
+// buffer's size, reading past its end throws instead.
+class StateReader {
+public:
+    explicit StateReader(const uint8_t* in, size_t size = std::numeric_limits<size_t>::max()) : in_(in), remaining_(size) { }
+    template<typename T>
+    void Read(T& value) {
+        Read(&value, sizeof(T));
+    }
+    void Read(void* data, size_t size) {
+        std::memcpy(data, ReadSpan(size), size);
+    }
+    // Returns the next size bytes in place and skips over them
+    const uint8_t* ReadSpan(size_t size) {
+        if(size > remaining_)
+            throw std::runtime_error("Save state is truncated");
+        const uint8_t* span = in_;
+        in_ += size;
+        remaining_ -= size;
+        return span;
+    }
+    size_t GetRemaining() {
+        return remaining_;
+    }
+private:
+    const uint8_t* in_;
+    size_t remaining_;
+};
+
+}
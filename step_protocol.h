@@ -0,0 +1,87 @@
+#pragma once
+
+#include <cstdint>
+
+namespace ozones {
+
+// Wire format of ozones-server, for clients in other processes. Every struct is
+// plain little-endian data with explicit padding so it can be mirrored in any
+// language.
+//
+// The socket is AF_UNIX SOCK_SEQPACKET. On connect the server sends one
+// StepHello with a shared memory file descriptor attached (SCM_RIGHTS) that
+// the client maps read-only: kObservationSlots Observations back to back.
+// The client then sends batches of up to kMaxBatchCommands StepCommands as
+// one message and receives one StepReply per batch naming the slot the
+// batch's observation was written to. Slots are reused round robin, so an
+// observation stays valid until kObservationSlots more batches have been sent.
+// A message that is not a whole number of commands, or holds more than
+// kMaxBatchCommands, runs nothing and is answered with failed set to 1.
+
+static constexpr uint32_t kStepMagic = 0x50545A4F;   // "OZTP"
+static constexpr uint32_t kStepVersion = 1;
+static constexpr uint32_t kObservationSlots = 8;
+static constexpr uint32_t kMaxBatchCommands = 64;
+static constexpr uint32_t kMaxSnapshots = 1024;
+static constexpr uint32_t kObservationRamSize = 0x800;
+static constexpr uint32_t kObservationWidth = 256;
+static constexpr uint32_t kObservationHeight = 240;
+
+enum StepOp : uint32_t {
+    // Runs count frames with input held on both ports, drawing the last one if render is set
+    kStepFrames = 1,
+    // Saves the machine into snapshot number index
+    kStepSnapshot = 2,
+    // Returns the machine to snapshot number index
+    kStepRestore = 3,
+    // Copies count bytes of work RAM from address index into the observation at the same offset
+    kStepReadRam = 4,
+    // Back to power-on, snapshots are kept
+    kStepHardReset = 5,
+    kStepSoftReset = 6
+};
+
+struct StepHello {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slots;
+    uint32_t slot_size;
+    uint64_t rom_hash;
+};
+
+struct StepCommand {
+    uint32_t op;
+    uint32_t count;
+    uint32_t index;
+    // Port 1 in the low byte, port 2 in the high byte
+    uint16_t input;
+    uint8_t render;
+    uint8_t reserved;
+};
+
+struct StepReply {
+    // 0, or the 1-based position of the command that failed; the batch stops there
+    uint32_t failed;
+    uint32_t slot;
+    // Frames since power-on, following restores
+    uint64_t frame;
+};
+
+struct Observation {
+    // Set by the batch that wrote this slot
+    uint64_t frame;
+    uint32_t batch;
+    // Whether framebuffer holds a frame drawn by this batch
+    uint32_t has_frame;
+    uint8_t reserved[48];
+    // Only the ranges read by this batch are current
+    uint8_t ram[kObservationRamSize];
+    // Palette indices, as Machine::GetFramebuffer
+    uint8_t framebuffer[kObservationWidth * kObservationHeight];
+};
+
+static_assert(sizeof(StepCommand) == 16, "StepCommand is part of the wire format");
+static_assert(sizeof(StepReply) == 16, "StepReply is part of the wire format");
+static_assert(sizeof(Observation) % 64 == 0, "Observations start on cache lines");
+
+}
@@ -0,0 +1,64 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "thread_pool.h"
+
+namespace ozones {
+
+ThreadPool::ThreadPool(unsigned threads) : next_(0), count_(0), pending_(0), stopping_(false) {
+    for(unsigned i = 0; i < threads; ++i)
+        workers_.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stopping_ = true;
+    }
+    work_cv_.notify_all();
+    for(auto& worker : workers_)
+        worker.join();
+}
+
+void ThreadPool::Dispatch(size_t count, std::function<void(size_t)> job) {
+    Wait();
+    if(workers_.empty()) {
+        for(size_t i = 0; i < count; ++i)
+            job(i);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        job_ = std::move(job);
+        next_ = 0;
+        count_ = count;
+        pending_ = count;
+    }
+    work_cv_.notify_all();
+}
+
+void ThreadPool::Wait() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    done_cv_.wait(lock, [this] { return pending_ == 0; });
+}
+
+unsigned ThreadPool::GetThreadCount() {
+    return workers_.size();
+}
+
+void ThreadPool::WorkerLoop() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    while(true) {
+        work_cv_.wait(lock, [this] { return stopping_ || next_ < count_; });
+        if(stopping_)
+            return;
+        size_t index = next_++;
+        lock.unlock();
+        job_(index);
+        lock.lock();
+        if(--pending_ == 0)
+            done_cv_.notify_all();
+    }
+}
+
+}
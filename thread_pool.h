@@ -0,0 +1,33 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ozones {
+
+// Fixed set of workers running one batch of indexed jobs at a time
+class ThreadPool {
+public:
+    ThreadPool(unsigned threads);
+    ~ThreadPool();
+    // Runs job(0) ... job(count - 1) on the workers and returns immediately
+    void Dispatch(size_t count, std::function<void(size_t)> job);
+    // Blocks until the last dispatched batch has finished
+    void Wait();
+    unsigned GetThreadCount();
+private:
+    void WorkerLoop();
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable done_cv_;
+    std::function<void(size_t)> job_;
+    size_t next_, count_, pending_;
+    bool stopping_;
+};
+
+}
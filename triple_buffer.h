@@ -0,0 +1,42 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ozones {
+
+// Lock-free single-producer/single-consumer handoff of the latest value.
+// The producer fills the back buffer and publishes it; the consumer picks up
+// the newest published buffer. Neither side ever waits for the other and a
+// buffer is never written while the consumer holds it.
+template<typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : buffers_(), back_(0), middle_(1), front_(2) { }
+    T& GetBackBuffer() {
+        return buffers_[back_];
+    }
+    void Publish() {
+        back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) & kIndexMask;
+    }
+    // Swaps in the newest published buffer, returns false if nothing new was published
+    bool Acquire() {
+        if(!(middle_.load(std::memory_order_relaxed) & kFresh))
+            return false;
+        front_ = middle_.exchange(front_, std::memory_order_acq_rel) & kIndexMask;
+        return true;
+    }
+    const T& GetFrontBuffer() {
+        return buffers_[front_];
+    }
+private:
+    static const uint8_t kIndexMask = 0x03;
+    static const uint8_t kFresh = 0x04;
+    std::array<T, 3> buffers_;
+    uint8_t back_;
+    std::atomic<uint8_t> middle_;
+    uint8_t front_;
+};
+
+}
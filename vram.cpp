@@ -0,0 +1,166 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "vram.h"
+#include <stdexcept>
+
+namespace ozones {
+
+Vram::Vram(std::shared_ptr<std::vector<uint8_t>> chr, bool chr_writable, Mirroring mirroring) : chr_(chr_writable ? std::make_shared<std::vector<uint8_t>>(*chr) : chr), chr_writable_(chr_writable), ciram_(), palettes_(), chr_pages_(chr_->size()), ciram_pages_(ciram_.size()) {
+    if(chr_->size() < kPageSize || chr_->size() % kPageSize)
+        throw std::runtime_error("CHR size is not a multiple of 1 KiB");
+    for(size_t i = 0; i < 8; ++i)
+        SetPatternBank(i, i);
+    SetMirroring(mirroring);
+}
+
+uint8_t Vram::ReadByte(size_t addr) {
+    addr &= 0x3FFF;
+    if(addr < 0x2000)
+        return pattern_pages_[addr >> 10][addr & 0x3FF];
+    if(addr < 0x3F00)
+        return nametables_[(addr >> 10) & 0x3][addr & 0x3FF];
+    return palettes_[PaletteIndex(addr)];
+}
+
+void Vram::WriteByte(size_t addr, uint8_t value) {
+    addr &= 0x3FFF;
+    if(addr < 0x2000) {
+        if(chr_writable_) {
+            uint8_t* byte = &pattern_pages_[addr >> 10][addr & 0x3FF];
+            *byte = value;
+            chr_pages_.MarkWritten(byte - chr_->data());
+        }
+    } else if(addr < 0x3F00) {
+        uint8_t* byte = &nametables_[(addr >> 10) & 0x3][addr & 0x3FF];
+        *byte = value;
+        ciram_pages_.MarkWritten(byte - ciram_.data());
+    } else {
+        palettes_[PaletteIndex(addr)] = value & 0x3F;
+    }
+}
+
+void Vram::SetMirroring(Mirroring mirroring) {
+    static const uint8_t kPages[][4] = {
+        { 0, 0, 1, 1 }, // kHorizontal
+        { 0, 1, 0, 1 }, // kVertical
+        { 0, 0, 0, 0 }, // kSingleScreenLower
+        { 1, 1, 1, 1 }, // kSingleScreenUpper
+        { 0, 1, 2, 3 }  // kFourScreen
+    };
+    mirroring_ = mirroring;
+    for(size_t i = 0; i < 4; ++i)
+        nametables_[i] = &ciram_[kPages[mirroring][i] * kPageSize];
+}
+
+Vram::Mirroring Vram::GetMirroring() {
+    return mirroring_;
+}
+
+void Vram::SetPatternBank(size_t page, size_t bank) {
+    bank %= chr_->size() / kPageSize;
+    pattern_banks_[page] = bank;
+    pattern_pages_[page] = chr_->data() + bank * kPageSize;
+}
+
+uint16_t Vram::GetPatternBank(size_t page) {
+    return pattern_banks_[page];
+}
+
+size_t Vram::GetNametableBank(size_t page) {
+    return (nametables_[page] - ciram_.data()) / kPageSize;
+}
+
+const uint8_t* Vram::GetPatternPage(size_t page) {
+    return pattern_pages_[page];
+}
+
+const uint8_t* Vram::GetNametablePage(size_t page) {
+    return nametables_[page];
+}
+
+const uint8_t* Vram::GetChr() {
+    return chr_->data();
+}
+
+size_t Vram::GetChrSize() {
+    return chr_->size();
+}
+
+bool Vram::IsChrWritable() {
+    return chr_writable_;
+}
+
+size_t Vram::GetMemoryUsage() {
+    return sizeof(*this) + (chr_writable_ ? chr_->capacity() : 0) + chr_pages_.GetMemoryUsage() + ciram_pages_.GetMemoryUsage();
+}
+
+const uint8_t* Vram::GetCiram() {
+    return ciram_.data();
+}
+
+const uint8_t* Vram::GetPalettes() {
+    return palettes_.data();
+}
+
+void Vram::SaveState(StateWriter& writer) {
+    if(chr_writable_)
+        writer.Write(chr_->data(), chr_->size());
+    SaveMappingState(writer);
+    writer.Write(ciram_);
+}
+
+void Vram::LoadState(StateReader& reader) {
+    if(chr_writable_)
+        reader.Read(chr_->data(), chr_->size());
+    LoadMappingState(reader);
+    reader.Read(ciram_);
+    chr_pages_.MarkAll();
+    ciram_pages_.MarkAll();
+}
+
+void Vram::SetStateEpoch(uint32_t epoch) {
+    chr_pages_.SetEpoch(epoch);
+    ciram_pages_.SetEpoch(epoch);
+}
+
+void Vram::SaveStateDelta(StateWriter& writer, uint32_t since) {
+    if(chr_writable_)
+        chr_pages_.SaveWrittenPages(writer, chr_->data(), since);
+    SaveMappingState(writer);
+    ciram_pages_.SaveWrittenPages(writer, ciram_.data(), since);
+}
+
+void Vram::LoadStateDelta(StateReader& reader) {
+    if(chr_writable_)
+        chr_pages_.LoadWrittenPages(reader, chr_->data());
+    LoadMappingState(reader);
+    ciram_pages_.LoadWrittenPages(reader, ciram_.data());
+}
+
+void Vram::RestoreState(StateReader& reader, uint32_t since) {
+    if(chr_writable_)
+        chr_pages_.RestoreWrittenPages(reader.ReadSpan(chr_->size()), chr_->data(), since);
+    LoadMappingState(reader);
+    ciram_pages_.RestoreWrittenPages(reader.ReadSpan(ciram_.size()), ciram_.data(), since);
+}
+
+// Bank and mirroring selection plus palette RAM, small enough to always copy whole
+void Vram::SaveMappingState(StateWriter& writer) {
+    writer.Write(pattern_banks_);
+    writer.Write(mirroring_);
+    writer.Write(palettes_);
+}
+
+void Vram::LoadMappingState(StateReader& reader) {
+    std::array<uint16_t, 8> pattern_banks;
+    reader.Read(pattern_banks);
+    for(size_t i = 0; i < 8; ++i)
+        SetPatternBank(i, pattern_banks[i]);
+    Mirroring mirroring;
+    reader.Read(mirroring);
+    SetMirroring(mirroring);
+    reader.Read(palettes_);
+}
+
+}
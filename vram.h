@@ -0,0 +1,76 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "page_tracker.h"
+#include "ram.h"
+#include "state.h"
+
+namespace ozones {
+
+// PPU address space: pattern tables at $0000-$1FFF and nametables at
+// $2000-$3EFF go through 1 KiB page tables so mappers can switch CHR banks
+// and mirroring at runtime, palettes at $3F00-$3FFF are decoded directly.
+class Vram : public Mappable {
+public:
+    enum Mirroring {
+        kHorizontal,
+        kVertical,
+        kSingleScreenLower,
+        kSingleScreenUpper,
+        kFourScreen
+    };
+    static const size_t kPageSize = 0x400;
+    // CHR ROM is shared, e.g. between forked machines; CHR RAM is copied
+    Vram(std::shared_ptr<std::vector<uint8_t>> chr, bool chr_writable, Mirroring mirroring);
+    uint8_t ReadByte(size_t addr) override;
+    void WriteByte(size_t addr, uint8_t value) override;
+    void SetMirroring(Mirroring mirroring);
+    Mirroring GetMirroring();
+    // Maps a 1 KiB page of $0000-$1FFF to a 1 KiB bank of CHR
+    void SetPatternBank(size_t page, size_t bank);
+    uint16_t GetPatternBank(size_t page);
+    size_t GetNametableBank(size_t page);
+    const uint8_t* GetPatternPage(size_t page);
+    const uint8_t* GetNametablePage(size_t page);
+    const uint8_t* GetChr();
+    size_t GetChrSize();
+    bool IsChrWritable();
+    const uint8_t* GetCiram();
+    const uint8_t* GetPalettes();
+    // CHR is only included when it is writable
+    void SaveState(StateWriter& writer);
+    void LoadState(StateReader& reader);
+    // Incremental counterparts; CHR RAM and CIRAM are tracked by page
+    void SetStateEpoch(uint32_t epoch);
+    void SaveStateDelta(StateWriter& writer, uint32_t since);
+    void LoadStateDelta(StateReader& reader);
+    void RestoreState(StateReader& reader, uint32_t since);
+    // Object and heap bytes, without shared CHR ROM
+    size_t GetMemoryUsage();
+private:
+    void SaveMappingState(StateWriter& writer);
+    void LoadMappingState(StateReader& reader);
+    static size_t PaletteIndex(size_t addr) {
+        addr &= 0x1F;
+        // $3F10/$3F14/$3F18/$3F1C mirror the backdrop entries below them
+        if((addr & 0x13) == 0x10)
+            addr &= 0x0F;
+        return addr;
+    }
+    std::shared_ptr<std::vector<uint8_t>> chr_;
+    bool chr_writable_;
+    std::array<uint16_t, 8> pattern_banks_;
+    std::array<uint8_t*, 8> pattern_pages_;
+    Mirroring mirroring_;
+    // 2 KiB of console CIRAM followed by 2 KiB of cartridge RAM used by four-screen boards
+    std::array<uint8_t, 0x1000> ciram_;
+    std::array<uint8_t*, 4> nametables_;
+    std::array<uint8_t, 0x20> palettes_;
+    PageTracker chr_pages_;
+    PageTracker ciram_pages_;
+};
+
+}
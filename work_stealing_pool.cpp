@@ -0,0 +1,70 @@
+// This is an open source non-commercial project. Dear PVS-Studio, please check it.
+// PVS-Studio Static Code Analyzer for C, C++ and C#: http://www.viva64.com
+
+#include "work_stealing_pool.h"
+#include <algorithm>
+#include <thread>
+#include <pthread.h>
+#include <sched.h>
+
+namespace ozones {
+
+WorkStealingPool::WorkStealingPool(unsigned threads, bool pin_threads) : threads_(std::max(threads, 1u)), pin_threads_(pin_threads) {
+    for(unsigned i = 0; i < threads_; ++i)
+        queues_.push_back(std::make_unique<Queue>());
+}
+
+void WorkStealingPool::Run(size_t count, std::function<void(size_t, unsigned)> job) {
+    // Contiguous slices, so a thief takes the jobs furthest from what the owner is working on
+    for(unsigned i = 0; i < threads_; ++i) {
+        std::lock_guard<std::mutex> lock(queues_[i]->mutex);
+        for(size_t index = count * i / threads_; index < count * (i + 1) / threads_; ++index)
+            queues_[i]->jobs.push_back(index);
+    }
+    std::vector<std::thread> workers;
+    for(unsigned i = 0; i < threads_; ++i)
+        workers.emplace_back(&WorkStealingPool::WorkerLoop, this, i, std::cref(job));
+    for(auto& worker : workers)
+        worker.join();
+}
+
+unsigned WorkStealingPool::GetThreadCount() {
+    return threads_;
+}
+
+void WorkStealingPool::WorkerLoop(unsigned worker, const std::function<void(size_t, unsigned)>& job) {
+    if(pin_threads_) {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(worker % std::max(std::thread::hardware_concurrency(), 1u), &cpus);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus);
+    }
+    size_t index;
+    while(TakeJob(worker, index))
+        job(index, worker);
+}
+
+bool WorkStealingPool::TakeJob(unsigned worker, size_t& index) {
+    {
+        Queue& own = *queues_[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if(!own.jobs.empty()) {
+            index = own.jobs.back();
+            own.jobs.pop_back();
+            return true;
+        }
+    }
+    // Jobs are never added while running, so one empty sweep means there is nothing left
+    for(unsigned i = 1; i < threads_; ++i) {
+        Queue& victim = *queues_[(worker + i) % threads_];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if(!victim.jobs.empty()) {
+            index = victim.jobs.front();
+            victim.jobs.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace ozones {
+
+// Runs a list of independent, long and unevenly sized jobs. Each worker
+// takes jobs from the back of its own queue and, once that is empty, steals
+// from the front of the others', so no worker idles while work remains.
+class WorkStealingPool {
+public:
+    // Pinned workers are bound to CPU (worker index % hardware threads)
+    WorkStealingPool(unsigned threads, bool pin_threads = false);
+    // Runs job(index, worker) for every index below count and returns when all are done
+    void Run(size_t count, std::function<void(size_t, unsigned)> job);
+    unsigned GetThreadCount();
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> jobs;
+    };
+    void WorkerLoop(unsigned worker, const std::function<void(size_t, unsigned)>& job);
+    bool TakeJob(unsigned worker, size_t& index);
+    unsigned threads_;
+    bool pin_threads_;
+    std::vector<std::unique_ptr<Queue>> queues_;
+};
+
+}